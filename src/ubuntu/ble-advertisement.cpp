@@ -0,0 +1,281 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-advertisement.h"
+
+#include <QBluetoothAddress>
+#include <QBluetoothUuid>
+#include <QtEndian>
+
+namespace {
+
+// Legacy advertising data plus scan response
+const int kTypicalRecordSize = 62;
+
+// The length octet of an AD structure also counts the type octet
+const int kMaxFieldSize = 254;
+
+}
+
+BleAdvertisement::BleAdvertisement()
+  : _address(0),
+    _rssi(0) {
+}
+
+BleAdvertisement::BleAdvertisement(const QBluetoothDeviceInfo& deviceInfo)
+  : _address(0),
+    _rssi(0) {
+  parse(deviceInfo);
+}
+
+/**
+ * @brief BleAdvertisement::parse
+ *
+ * Extracts name, advertised service UUIDs and manufacturer specific data
+ * from the device info and encodes them as AD structures.
+ * Qt 5 does not surface service data or the TX power level of an
+ * advertisement, those AD types are only present in records that carry
+ * them (e.g. replayed raw records).
+ *
+ * @param deviceInfo
+ */
+void BleAdvertisement::parse(const QBluetoothDeviceInfo& deviceInfo) {
+  _address = deviceInfo.address().toUInt64();
+  _name = deviceInfo.name();
+  _rssi = deviceInfo.rssi();
+  _serviceClasses = deviceInfo.serviceClasses();
+
+  // keeps the allocation around when the record is reused
+  _data.resize(0);
+  if (_data.capacity() < kTypicalRecordSize) {
+    _data.reserve(kTypicalRecordSize);
+  }
+
+  if (!_name.isEmpty()) {
+    appendName();
+  }
+
+  QBluetoothDeviceInfo::DataCompleteness completeness;
+  const QList<QBluetoothUuid> uuids = deviceInfo.serviceUuids(&completeness);
+  if (!uuids.isEmpty()) {
+    appendUuids(uuids, completeness == QBluetoothDeviceInfo::DataComplete);
+  }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+  const QHash<quint16, QByteArray> manufacturerData =
+    deviceInfo.manufacturerData();
+  for (auto it = manufacturerData.constBegin();
+       it != manufacturerData.constEnd();
+       ++it) {
+    const int size = qMin(it.value().size() + 2, kMaxFieldSize);
+    _data.append(char(size + 1));
+    _data.append(char(ManufacturerSpecificData));
+    _data.append(char(it.key() & 0xff));
+    _data.append(char(it.key() >> 8));
+    _data.append(it.value().constData(), size - 2);
+  }
+#endif
+}
+
+void BleAdvertisement::swap(BleAdvertisement& other) {
+  qSwap(_address, other._address);
+  _name.swap(other._name);
+  qSwap(_rssi, other._rssi);
+  qSwap(_serviceClasses, other._serviceClasses);
+  _data.swap(other._data);
+}
+
+void BleAdvertisement::appendName() {
+  const int size = qMin(_name.size(), kMaxFieldSize);
+  const int header = _data.size();
+  _data.append(char(size + 1));
+  _data.append(char(size < _name.size() ? ShortenedLocalName
+                                        : CompleteLocalName));
+
+  // ASCII names are encoded in place, other names go through UTF-8
+  const QChar *chars = _name.constData();
+  for (int i = 0; i < size; ++i) {
+    const ushort c = chars[i].unicode();
+    if (c >= 0x80) {
+      _data.resize(header);
+      const QByteArray name = _name.toUtf8();
+      int length = name.size();
+      quint8 type = CompleteLocalName;
+      if (length > kMaxFieldSize) {
+        // never cut a multi byte sequence, back up over continuation bytes
+        length = kMaxFieldSize;
+        while (length > 0 && (uchar(name.at(length)) & 0xC0) == 0x80) {
+          --length;
+        }
+        type = ShortenedLocalName;
+      }
+      appendField(type, name.constData(), length);
+      return;
+    }
+    _data.append(char(c));
+  }
+}
+
+void BleAdvertisement::appendField(quint8 type, const char *data, int size) {
+  size = qMin(size, kMaxFieldSize);
+  _data.append(char(size + 1));
+  _data.append(char(type));
+  _data.append(data, size);
+}
+
+void BleAdvertisement::appendUuids(const QList<QBluetoothUuid>& uuids,
+                                   bool complete) {
+  uchar buffer[kMaxFieldSize];
+
+  // one AD structure per UUID width
+  const int widths[] = { 2, 4, 16 };
+  const quint8 types[] = {
+    quint8(complete ? CompleteServices16 : IncompleteServices16),
+    quint8(complete ? CompleteServices32 : IncompleteServices32),
+    quint8(complete ? CompleteServices128 : IncompleteServices128)
+  };
+
+  for (int w = 0; w < 3; ++w) {
+    int size = 0;
+    Q_FOREACH(const QBluetoothUuid& uuid, uuids) {
+      if (uuid.minimumSize() != widths[w]
+          || size + widths[w] > kMaxFieldSize) {
+        continue;
+      }
+      size += uuidToLittleEndian(uuid, buffer + size);
+    }
+    if (size > 0) {
+      appendField(types[w], reinterpret_cast<const char *>(buffer), size);
+    }
+  }
+}
+
+/**
+ * @brief BleAdvertisement::uuidWidth
+ *
+ * @param type AD type
+ * @return the width in bytes of the UUIDs listed in an AD structure of
+ *         this type, or 0 if the type is not a service UUID list
+ */
+int BleAdvertisement::uuidWidth(quint8 type) {
+  switch (type) {
+  case IncompleteServices16:
+  case CompleteServices16:
+    return 2;
+  case IncompleteServices32:
+  case CompleteServices32:
+    return 4;
+  case IncompleteServices128:
+  case CompleteServices128:
+    return 16;
+  }
+  return 0;
+}
+
+/**
+ * @brief BleAdvertisement::uuidToLittleEndian
+ *
+ * Writes the shortest form of the UUID in AD structure byte order.
+ *
+ * @param uuid
+ * @param out receives up to 16 bytes
+ * @return the number of bytes written
+ */
+int BleAdvertisement::uuidToLittleEndian(const QBluetoothUuid& uuid,
+                                         uchar *out) {
+  bool ok = false;
+  switch (uuid.minimumSize()) {
+  case 2:
+    qToLittleEndian<quint16>(uuid.toUInt16(&ok), out);
+    return ok ? 2 : 0;
+  case 4:
+    qToLittleEndian<quint32>(uuid.toUInt32(&ok), out);
+    return ok ? 4 : 0;
+  case 16: {
+    // quint128 is big endian, AD structures are little endian
+    const quint128 value = uuid.toUInt128();
+    for (int i = 0; i < 16; ++i) {
+      out[i] = value.data[15 - i];
+    }
+    return 16;
+  }
+  }
+  return 0;
+}
+
+/**
+ * @brief BleAdvertisement::nextField
+ *
+ * Walks the AD structures of the record without copying.
+ *
+ * @param offset offset of the AD structure to decode, 0 for the first one
+ * @param type receives the AD type
+ * @param value receives a view on the AD data
+ * @return the offset of the following AD structure, or -1 at the end
+ */
+int BleAdvertisement::nextField(int offset, quint8 *type, Field *value) const {
+  const uchar *d = reinterpret_cast<const uchar *>(_data.constData());
+  const int size = _data.size();
+
+  if (offset >= size) {
+    return -1;
+  }
+
+  const int length = d[offset];
+  if (length == 0 || offset + 1 + length > size) {
+    // early termination as allowed by the specification, or truncated
+    return -1;
+  }
+  *type = d[offset + 1];
+  value->data = d + offset + 2;
+  value->size = length - 1;
+  return offset + 1 + length;
+}
+
+BleAdvertisement::Field BleAdvertisement::field(quint8 type) const {
+  Field value = { Q_NULLPTR, 0 };
+  quint8 t;
+  int offset = 0;
+  while ((offset = nextField(offset, &t, &value)) >= 0) {
+    if (t == type) {
+      return value;
+    }
+  }
+  value.data = Q_NULLPTR;
+  value.size = 0;
+  return value;
+}
+
+int BleAdvertisement::txPower() const {
+  const Field f = field(TxPowerLevel);
+  if (f.isNull() || f.size < 1) {
+    return TxPowerUnknown;
+  }
+  return qint8(f.data[0]);
+}
+
+int BleAdvertisement::manufacturerId() const {
+  const Field f = field(ManufacturerSpecificData);
+  if (f.isNull() || f.size < 2) {
+    return -1;
+  }
+  return qFromLittleEndian<quint16>(f.data);
+}
@@ -0,0 +1,104 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef BLE_ADVERTISEMENT_H
+#define BLE_ADVERTISEMENT_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+
+/**
+ * @brief The BleAdvertisement class
+ *
+ * Compact advertisement record built once per discovered device.
+ * The payload is a sequence of AD structures (length, type, data) as
+ * defined in the Bluetooth Core Specification, which is the same raw
+ * format reported by the Android implementation.
+ */
+class BleAdvertisement {
+public:
+    enum AdType {
+        Flags = 0x01,
+        IncompleteServices16 = 0x02,
+        CompleteServices16 = 0x03,
+        IncompleteServices32 = 0x04,
+        CompleteServices32 = 0x05,
+        IncompleteServices128 = 0x06,
+        CompleteServices128 = 0x07,
+        ShortenedLocalName = 0x08,
+        CompleteLocalName = 0x09,
+        TxPowerLevel = 0x0A,
+        ServiceData16 = 0x16,
+        ServiceData32 = 0x20,
+        ServiceData128 = 0x21,
+        ManufacturerSpecificData = 0xFF
+    };
+
+    // "No TX power information available" as per the Core Specification
+    static const int TxPowerUnknown = 127;
+
+    struct Field {
+        const uchar *data;
+        int size;
+
+        bool isNull() const { return data == Q_NULLPTR; }
+    };
+
+    BleAdvertisement();
+    explicit BleAdvertisement(const QBluetoothDeviceInfo& deviceInfo);
+
+    // Rebuilds the record in place, reusing the existing buffer.
+    void parse(const QBluetoothDeviceInfo& deviceInfo);
+    void swap(BleAdvertisement& other);
+
+    quint64 address() const { return _address; }
+    const QString& name() const { return _name; }
+    qint16 rssi() const { return _rssi; }
+    QBluetoothDeviceInfo::ServiceClasses serviceClasses() const {
+        return _serviceClasses;
+    }
+
+    const QByteArray& data() const { return _data; }
+
+    int txPower() const;
+    int manufacturerId() const;
+
+    Field field(quint8 type) const;
+    int nextField(int offset, quint8 *type, Field *value) const;
+
+    static int uuidWidth(quint8 type);
+    static int uuidToLittleEndian(const QBluetoothUuid& uuid, uchar *out);
+
+private:
+    void appendName();
+    void appendField(quint8 type, const char *data, int size);
+    void appendUuids(const QList<QBluetoothUuid>& uuids, bool complete);
+
+    quint64 _address;
+    QString _name;
+    qint16 _rssi;
+    QBluetoothDeviceInfo::ServiceClasses _serviceClasses;
+    QByteArray _data;
+};
+
+#endif // BLE_ADVERTISEMENT_H
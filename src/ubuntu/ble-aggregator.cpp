@@ -0,0 +1,193 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-aggregator.h"
+
+#include <QtNumeric>
+
+namespace {
+
+// The kernels keep four independent accumulators so that the compiler
+// can map them onto vector registers.
+
+void minMax(const double *x, int n, double *min, double *max) {
+  double mn[4] = { x[0], x[0], x[0], x[0] };
+  double mx[4] = { x[0], x[0], x[0], x[0] };
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (int k = 0; k < 4; ++k) {
+      mn[k] = x[i + k] < mn[k] ? x[i + k] : mn[k];
+      mx[k] = x[i + k] > mx[k] ? x[i + k] : mx[k];
+    }
+  }
+  for (; i < n; ++i) {
+    mn[0] = x[i] < mn[0] ? x[i] : mn[0];
+    mx[0] = x[i] > mx[0] ? x[i] : mx[0];
+  }
+  *min = qMin(qMin(mn[0], mn[1]), qMin(mn[2], mn[3]));
+  *max = qMax(qMax(mx[0], mx[1]), qMax(mx[2], mx[3]));
+}
+
+double sum(const double *x, int n) {
+  double s[4] = { 0, 0, 0, 0 };
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (int k = 0; k < 4; ++k) {
+      s[k] += x[i + k];
+    }
+  }
+  for (; i < n; ++i) {
+    s[0] += x[i];
+  }
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+}
+
+BleAggregator::BleAggregator()
+  : _window(0),
+    _windowStart(0),
+    _started(false),
+    _channels(0),
+    _size(0),
+    _summaryCount(0),
+    _summaryChannels(0) {
+}
+
+void BleAggregator::setWindow(qint64 window) {
+  _window = qMax(qint64(0), window);
+}
+
+bool BleAggregator::add(qint64 now, const double *values, int count) {
+  bool closed = false;
+  if (!_started) {
+    _started = true;
+    _windowStart = now;
+    _channels = count;
+    _size = 0;
+  } else if (now - _windowStart >= _window) {
+    if (_size > 0) {
+      summarize();
+      closed = true;
+    }
+    // windows stay aligned to the first one, empty windows are skipped
+    _windowStart = now - (now - _windowStart) % _window;
+    _channels = count;
+    _size = 0;
+  } else if (_size == 0) {
+    // first sample after a flush
+    _channels = count;
+  }
+
+  if (_size == 0) {
+    for (int c = 0; c < count; ++c) {
+      _valid[c] = 0;
+    }
+  }
+  _channels = qMin(_channels, count);
+  for (int c = 0; c < _channels; ++c) {
+    // a NaN would turn every summary of its value into NaN
+    if (qIsNaN(values[c])) {
+      continue;
+    }
+    QVector<double>& samples = _samples[c];
+    // keeps the capacity reached by earlier windows
+    if (samples.size() <= _valid[c]) {
+      samples.resize(qMax(64, 2 * _valid[c]));
+    }
+    samples[_valid[c]++] = values[c];
+  }
+  ++_size;
+  return closed;
+}
+
+bool BleAggregator::flush(qint64 now) {
+  if (_size == 0) {
+    return false;
+  }
+  summarize();
+  _size = 0;
+  if (now - _windowStart >= _window) {
+    _windowStart = now - (now - _windowStart) % _window;
+  }
+  return true;
+}
+
+void BleAggregator::summarize() {
+  _summaryCount = _size;
+  _summaryChannels = _channels;
+  for (int c = 0; c < _channels; ++c) {
+    const double *x = _samples[c].constData();
+    const int n = _valid[c];
+    Summary& summary = _summary[c];
+    summary.nan = _size - n;
+    if (n == 0) {
+      summary.min = summary.max = summary.mean = summary.last = qQNaN();
+      continue;
+    }
+    minMax(x, n, &summary.min, &summary.max);
+    summary.mean = sum(x, n) / n;
+    summary.last = x[n - 1];
+  }
+}
+
+void BleAggregator::write(BleJsonWriter& writer) const {
+  writer.beginObject();
+  writer.key(QLatin1String("count"));
+  writer.value(_summaryCount);
+
+  writer.key(QLatin1String("min"));
+  writer.beginArray();
+  for (int c = 0; c < _summaryChannels; ++c) {
+    writer.value(_summary[c].min);
+  }
+  writer.endArray();
+
+  writer.key(QLatin1String("max"));
+  writer.beginArray();
+  for (int c = 0; c < _summaryChannels; ++c) {
+    writer.value(_summary[c].max);
+  }
+  writer.endArray();
+
+  writer.key(QLatin1String("mean"));
+  writer.beginArray();
+  for (int c = 0; c < _summaryChannels; ++c) {
+    writer.value(_summary[c].mean);
+  }
+  writer.endArray();
+
+  writer.key(QLatin1String("last"));
+  writer.beginArray();
+  for (int c = 0; c < _summaryChannels; ++c) {
+    writer.value(_summary[c].last);
+  }
+  writer.endArray();
+
+  writer.key(QLatin1String("nan"));
+  writer.beginArray();
+  for (int c = 0; c < _summaryChannels; ++c) {
+    writer.value(_summary[c].nan);
+  }
+  writer.endArray();
+
+  writer.endObject();
+}
@@ -0,0 +1,98 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_AGGREGATOR_H
+#define BLE_AGGREGATOR_H
+
+#include <QVector>
+
+#include "ble-decoder.h"
+#include "ble-json-writer.h"
+
+/**
+ * @brief The BleAggregator class
+ *
+ * Buffers decoded samples over a time window and summarizes each window
+ * into min, max, mean and last per value. NaN values, e.g. the NaN and
+ * NRes codes of IEEE 11073 formats, are left out of the summary and
+ * counted on their own.
+ *
+ * Samples are stored one array per value so that the summary kernels run
+ * over contiguous doubles.
+ */
+class BleAggregator {
+public:
+    BleAggregator();
+
+    // window length in ms, 0 disables aggregation
+    void setWindow(qint64 window);
+    bool isEnabled() const { return _window > 0; }
+
+    /**
+     * Adds a sample taken at now (ms). Returns true if the sample closed
+     * the previous window, whose summary is then written by write() until
+     * the next call.
+     */
+    bool add(qint64 now, const double *values, int count);
+
+    // The window holds samples not summarized yet.
+    bool hasSamples() const { return _size > 0; }
+    // ms the current window closes at, in the time of add()
+    qint64 windowEnd() const { return _windowStart + _window; }
+    /**
+     * Summarizes the samples held, for a window that ended without a
+     * sample after it or when the stream stops. Returns false if there
+     * were none; the summary is then written by write() as after add().
+     */
+    bool flush(qint64 now);
+
+    // {"count": n, "min": [...], "max": [...], "mean": [...], "last": [...],
+    //  "nan": [...]}, null for a value that was NaN in every sample
+    void write(BleJsonWriter& writer) const;
+
+private:
+    struct Summary {
+        double min;
+        double max;
+        double mean;
+        double last;
+        int nan;
+    };
+
+    void summarize();
+
+    qint64 _window;
+    qint64 _windowStart;
+    bool _started;
+
+    // values present in every sample of the window
+    int _channels;
+    int _size;
+    // values that are not NaN, per value
+    int _valid[BleDecoder::MaxValues];
+    QVector<double> _samples[BleDecoder::MaxValues];
+
+    int _summaryCount;
+    int _summaryChannels;
+    Summary _summary[BleDecoder::MaxValues];
+};
+
+#endif // BLE_AGGREGATOR_H
@@ -0,0 +1,137 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-connection-pool.h"
+
+namespace {
+
+// slot index in the low half, generation in the high half
+quint64 makeHandle(int index, quint32 generation) {
+  return (quint64(generation) << 32) | quint32(index);
+}
+
+}
+
+BleConnectionPool::BleConnectionPool()
+  : _firstFree(-1),
+    _groupsInUse(0),
+    _liveConnections(0),
+    _overflows(0) {
+}
+
+BleConnectionPool::~BleConnectionPool() {
+  for (int i = 0; i < _slots.size(); ++i) {
+    if (_slots[i].inUse) {
+      release(makeHandle(i, _slots[i].generation));
+    }
+  }
+}
+
+/**
+ * @brief BleConnectionPool::acquire
+ *
+ * Returns an empty group, released when scope is destroyed.
+ *
+ * @param scope
+ */
+BleConnectionPool::Group BleConnectionPool::acquire(QObject *scope) {
+  int index = _firstFree;
+  if (index >= 0) {
+    _firstFree = _slots[index].nextFree;
+  } else {
+    index = _slots.size();
+    _slots.append(Slot());
+  }
+
+  Slot& s = _slots[index];
+  s.inUse = true;
+  s.nextFree = -1;
+  ++_groupsInUse;
+
+  const Group group(this, makeHandle(index, s.generation));
+  group.connect(scope, &QObject::destroyed, [group]() {
+      group.release();
+    });
+  return group;
+}
+
+BleConnectionPool::Slot *BleConnectionPool::slot(quint64 handle) {
+  const int index = int(quint32(handle));
+  if (index >= _slots.size()) {
+    return Q_NULLPTR;
+  }
+  Slot& s = _slots[index];
+  if (!s.inUse || s.generation != quint32(handle >> 32)) {
+    return Q_NULLPTR;
+  }
+  return &s;
+}
+
+void BleConnectionPool::add(quint64 handle,
+                            const QMetaObject::Connection& connection) {
+  Slot *s = slot(handle);
+  if (!s) {
+    // the operation completed while its handlers were being connected
+    QObject::disconnect(connection);
+    return;
+  }
+  if (s->count < MaxConnections) {
+    s->connections[s->count] = connection;
+  } else {
+    // keeps the connection rather than leaking it past the group
+    s->overflow.append(connection);
+    ++_overflows;
+  }
+  ++s->count;
+  ++_liveConnections;
+}
+
+void BleConnectionPool::release(quint64 handle) {
+  Slot *s = slot(handle);
+  if (!s) {
+    return;
+  }
+
+  // the slot is free before any handler could run again
+  QMetaObject::Connection connections[MaxConnections];
+  QVector<QMetaObject::Connection> overflow;
+  const int count = s->count;
+  for (int i = 0; i < qMin(count, int(MaxConnections)); ++i) {
+    connections[i] = s->connections[i];
+    s->connections[i] = QMetaObject::Connection();
+  }
+  overflow.swap(s->overflow);
+  const int index = int(quint32(handle));
+  s->inUse = false;
+  s->count = 0;
+  ++s->generation;
+  s->nextFree = _firstFree;
+  _firstFree = index;
+  --_groupsInUse;
+  _liveConnections -= count;
+
+  for (int i = 0; i < qMin(count, int(MaxConnections)); ++i) {
+    QObject::disconnect(connections[i]);
+  }
+  Q_FOREACH(const QMetaObject::Connection& connection, overflow) {
+    QObject::disconnect(connection);
+  }
+}
@@ -0,0 +1,109 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_CONNECTION_POOL_H
+#define BLE_CONNECTION_POOL_H
+
+#include <QMetaObject>
+#include <QObject>
+#include <QVector>
+
+/**
+ * @brief The BleConnectionPool class
+ *
+ * Signal connections of the asynchronous plugin operations, in groups
+ * torn down together once the operation completes. Groups are recycled,
+ * so an operation does not allocate to track its connections, and a
+ * handle to a released group is harmless: its slot has a new generation.
+ *
+ * A group is bound to the scope object of the operation and is released
+ * when the scope is destroyed before the operation completed.
+ */
+class BleConnectionPool {
+public:
+    // connections of a group held in place, including the one to the scope;
+    // a group with more spills over to the heap
+    static const int MaxConnections = 6;
+
+    /**
+     * Handle to a group, cheap to copy into the handlers of the operation.
+     */
+    class Group {
+    public:
+        Group() : _pool(Q_NULLPTR), _handle(0) {}
+
+        template<typename Sender, typename Signal, typename Functor>
+        void connect(const Sender *sender, Signal signal, Functor functor) const {
+            _pool->add(_handle, QObject::connect(sender, signal, functor));
+        }
+
+        // Disconnects all connections of the group, once.
+        void release() const { _pool->release(_handle); }
+
+    private:
+        friend class BleConnectionPool;
+
+        Group(BleConnectionPool *pool, quint64 handle)
+          : _pool(pool), _handle(handle) {}
+
+        BleConnectionPool *_pool;
+        quint64 _handle;
+    };
+
+    BleConnectionPool();
+    // Disconnects the groups still in use.
+    ~BleConnectionPool();
+
+    Group acquire(QObject *scope);
+
+    // connections held by groups in use
+    int liveConnections() const { return _liveConnections; }
+    int groupsInUse() const { return _groupsInUse; }
+    // groups allocated, in use or free
+    int capacity() const { return _slots.size(); }
+    // connections added to a group beyond MaxConnections
+    int overflows() const { return _overflows; }
+
+private:
+    struct Slot {
+        Slot() : generation(0), count(0), nextFree(-1), inUse(false) {}
+
+        quint32 generation;
+        int count;
+        int nextFree;
+        bool inUse;
+        QMetaObject::Connection connections[MaxConnections];
+        QVector<QMetaObject::Connection> overflow;
+    };
+
+    void add(quint64 handle, const QMetaObject::Connection& connection);
+    void release(quint64 handle);
+    // slot of a handle, Q_NULLPTR if the group was released
+    Slot *slot(quint64 handle);
+
+    QVector<Slot> _slots;
+    int _firstFree;
+    int _groupsInUse;
+    int _liveConnections;
+    int _overflows;
+};
+
+#endif // BLE_CONNECTION_POOL_H
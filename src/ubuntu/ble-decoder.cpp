@@ -0,0 +1,229 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-decoder.h"
+
+#include <cmath>
+#include <limits>
+
+#include <QtEndian>
+
+namespace {
+
+const double kNaN = std::numeric_limits<double>::quiet_NaN();
+const double kInfinity = std::numeric_limits<double>::infinity();
+
+double pow10(int exponent) {
+  static const double powers[] = {
+    1e-8, 1e-7, 1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1,
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8
+  };
+  if (exponent >= -8 && exponent <= 8) {
+    return powers[exponent + 8];
+  }
+  return std::pow(10.0, exponent);
+}
+
+// sign extends the low bits of value
+template<int Bits>
+qint32 signExtend(quint32 value) {
+  const quint32 sign = quint32(1) << (Bits - 1);
+  return qint32((value ^ sign) - sign);
+}
+
+template<int Bytes>
+quint32 readLittleEndian(const uchar *data) {
+  quint32 value = 0;
+  for (int i = 0; i < Bytes; ++i) {
+    value |= quint32(data[i]) << (8 * i);
+  }
+  return value;
+}
+
+template<BleDecoder::Format F>
+struct Decoder;
+
+// Heart Rate Measurement (0x2A37):
+// [beats per minute, energy expended in kJ, RR intervals in ms...]
+template<>
+struct Decoder<BleDecoder::HeartRateMeasurement> {
+  static int decode(const uchar *data, int size, double *values) {
+    if (size < 2) {
+      return 0;
+    }
+    const uchar flags = data[0];
+    int offset = 1;
+
+    const int hrSize = (flags & 0x01) ? 2 : 1;
+    if (size < offset + hrSize) {
+      return 0;
+    }
+    values[0] = hrSize == 2 ? qFromLittleEndian<quint16>(data + offset)
+                            : data[offset];
+    offset += hrSize;
+
+    values[1] = kNaN;
+    if (flags & 0x08) {
+      if (size < offset + 2) {
+        return 0;
+      }
+      values[1] = qFromLittleEndian<quint16>(data + offset);
+      offset += 2;
+    }
+
+    int count = 2;
+    if (flags & 0x10) {
+      for (; offset + 2 <= size && count < BleDecoder::MaxValues;
+           offset += 2) {
+        values[count++] =
+          qFromLittleEndian<quint16>(data + offset) * 1000.0 / 1024.0;
+      }
+    }
+    return count;
+  }
+};
+
+// Battery Level (0x2A19): [percent]
+template<>
+struct Decoder<BleDecoder::BatteryLevel> {
+  static int decode(const uchar *data, int size, double *values) {
+    if (size < 1) {
+      return 0;
+    }
+    values[0] = data[0];
+    return 1;
+  }
+};
+
+// IEEE 11073-20601 FLOAT and SFLOAT, one value per field in the payload
+template<int Bytes, int MantissaBits>
+struct MedicalFloatDecoder {
+  static double value(const uchar *data) {
+    const quint32 raw = readLittleEndian<Bytes>(data);
+    const quint32 mantissaMask = (quint32(1) << MantissaBits) - 1;
+    const quint32 mantissa = raw & mantissaMask;
+
+    // special values are exact codes with a zero exponent, at the top of
+    // the positive mantissa range: 0x07FF is NaN but 0xF7FF is 204.7
+    const quint32 nan = mantissaMask >> 1;
+    if (raw == nan - 1) {
+      return kInfinity;
+    }
+    if (raw == nan + 3) {
+      return -kInfinity;
+    }
+    if (raw >= nan && raw <= nan + 2) {
+      // NaN, NRes and reserved
+      return kNaN;
+    }
+
+    const int exponent =
+      signExtend<Bytes * 8 - MantissaBits>(raw >> MantissaBits);
+    return signExtend<MantissaBits>(mantissa) * pow10(exponent);
+  }
+
+  static int decode(const uchar *data, int size, double *values) {
+    int count = 0;
+    for (int offset = 0;
+         offset + Bytes <= size && count < BleDecoder::MaxValues;
+         offset += Bytes) {
+      values[count++] = value(data + offset);
+    }
+    return count;
+  }
+};
+
+template<>
+struct Decoder<BleDecoder::Ieee11073Float>
+  : MedicalFloatDecoder<4, 24> {};
+
+template<>
+struct Decoder<BleDecoder::Ieee11073SFloat>
+  : MedicalFloatDecoder<2, 12> {};
+
+// x, y, z sensor readings, signed little endian
+template<int Bytes>
+struct TripletDecoder {
+  static int decode(const uchar *data, int size, double *values) {
+    if (size < 3 * Bytes) {
+      return 0;
+    }
+    values[0] = signExtend<Bytes * 8>(readLittleEndian<Bytes>(data));
+    values[1] = signExtend<Bytes * 8>(readLittleEndian<Bytes>(data + Bytes));
+    values[2] = signExtend<Bytes * 8>(readLittleEndian<Bytes>(data + 2 * Bytes));
+    return 3;
+  }
+};
+
+template<>
+struct Decoder<BleDecoder::Int16Triplet> : TripletDecoder<2> {};
+
+template<>
+struct Decoder<BleDecoder::Int24Triplet> : TripletDecoder<3> {};
+
+typedef int (*DecodeFunction)(const uchar *data, int size, double *values);
+
+struct DecoderEntry {
+  BleDecoder::Format format;
+  const char *name;
+  DecodeFunction decode;
+};
+
+// indexed by BleDecoder::Format
+const DecoderEntry kDecoders[] = {
+  { BleDecoder::Raw, "raw", Q_NULLPTR },
+  { BleDecoder::HeartRateMeasurement, "heartRate",
+    &Decoder<BleDecoder::HeartRateMeasurement>::decode },
+  { BleDecoder::BatteryLevel, "batteryLevel",
+    &Decoder<BleDecoder::BatteryLevel>::decode },
+  { BleDecoder::Ieee11073Float, "ieee11073Float",
+    &Decoder<BleDecoder::Ieee11073Float>::decode },
+  { BleDecoder::Ieee11073SFloat, "ieee11073SFloat",
+    &Decoder<BleDecoder::Ieee11073SFloat>::decode },
+  { BleDecoder::Int16Triplet, "int16Triplet",
+    &Decoder<BleDecoder::Int16Triplet>::decode },
+  { BleDecoder::Int24Triplet, "int24Triplet",
+    &Decoder<BleDecoder::Int24Triplet>::decode }
+};
+
+const int kDecoderCount = sizeof(kDecoders) / sizeof(kDecoders[0]);
+
+}
+
+bool BleDecoder::fromName(const QString& name, Format *format) {
+  for (int i = 0; i < kDecoderCount; ++i) {
+    if (name == QLatin1String(kDecoders[i].name)) {
+      *format = kDecoders[i].format;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *BleDecoder::name(Format format) {
+  return kDecoders[format].name;
+}
+
+int BleDecoder::decode(Format format, const uchar *data, int size,
+                       double *values) {
+  const DecodeFunction decode = kDecoders[format].decode;
+  return decode ? decode(data, size, values) : 0;
+}
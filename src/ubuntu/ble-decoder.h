@@ -0,0 +1,62 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef BLE_DECODER_H
+#define BLE_DECODER_H
+
+#include <QString>
+
+/**
+ * @brief The BleDecoder class
+ *
+ * Decoders for standard characteristic value formats, turning a
+ * notification payload into an array of numbers.
+ *
+ * To add a format, add it to Format, specialize Decoder<> in
+ * ble-decoder.cpp and add a row to the decoder table.
+ */
+class BleDecoder {
+public:
+    enum Format {
+        Raw,
+        HeartRateMeasurement,
+        BatteryLevel,
+        Ieee11073Float,
+        Ieee11073SFloat,
+        Int16Triplet,
+        Int24Triplet
+    };
+
+    // upper bound of the values produced from one payload
+    static const int MaxValues = 16;
+
+    static bool fromName(const QString& name, Format *format);
+    static const char *name(Format format);
+
+    /**
+     * Decodes data into values, not scaled.
+     * Returns the number of values, 0 if the payload is too short.
+     * Values not present in the payload are NaN.
+     */
+    static int decode(Format format, const uchar *data, int size,
+                      double *values);
+};
+
+#endif // BLE_DECODER_H
@@ -0,0 +1,153 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-journal.h"
+
+#include <chrono>
+
+#include <QBluetoothAddress>
+
+#include "ble-peripheral.h"
+#include "ble-uuid.h"
+
+namespace {
+
+const quint64 kMask = BleJournal::Capacity - 1;
+
+const char *eventName(int type) {
+  switch (type) {
+  case BleJournal::ScanStarted: return "scanStarted";
+  case BleJournal::ScanStopped: return "scanStopped";
+  case BleJournal::ConnectRequested: return "connectRequested";
+  case BleJournal::Connected: return "connected";
+  case BleJournal::Disconnected: return "disconnected";
+  case BleJournal::ControllerStateChanged: return "controllerStateChanged";
+  case BleJournal::ControllerError: return "controllerError";
+  case BleJournal::ServiceStateChanged: return "serviceStateChanged";
+  case BleJournal::ServiceError: return "serviceError";
+  case BleJournal::OperationQueued: return "operationQueued";
+  case BleJournal::OperationStarted: return "operationStarted";
+  case BleJournal::OperationCompleted: return "operationCompleted";
+  case BleJournal::OperationFailed: return "operationFailed";
+  }
+  return "unknown";
+}
+
+const char *operationName(int operation) {
+  switch (operation) {
+  case BlePeripheral::ReadCharacteristic: return "read";
+  case BlePeripheral::WriteCharacteristic: return "write";
+  case BlePeripheral::WriteCharacteristicWithoutResponse:
+    return "writeWithoutResponse";
+  case BlePeripheral::ReadDescriptor: return "readDescriptor";
+  case BlePeripheral::WriteDescriptor: return "writeDescriptor";
+  }
+  return "unknown";
+}
+
+qint64 monotonicNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+BleJournal::BleJournal()
+  : _head(0) {
+  for (Entry& entry : _entries) {
+    entry.sequence.store(0, std::memory_order_relaxed);
+  }
+}
+
+void BleJournal::record(EventType type,
+                        quint64 address,
+                        const QBluetoothUuid& attribute,
+                        int operation,
+                        qint64 value) {
+  const quint64 index = _head.fetch_add(1, std::memory_order_relaxed);
+  Entry& entry = _entries[index & kMask];
+
+  entry.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  entry.time = monotonicNanoseconds();
+  entry.address = address;
+  entry.attribute = attribute.toUInt128();
+  entry.value = value;
+  entry.type = qint16(type);
+  entry.operation = qint16(operation);
+
+  entry.sequence.store(index + 1, std::memory_order_release);
+}
+
+/**
+ * @brief BleJournal::write
+ *
+ * Writes a snapshot of the ring. Slots being written, or overwritten
+ * while copied, are left out.
+ *
+ * @param writer
+ */
+void BleJournal::write(BleJsonWriter& writer) const {
+  const quint64 head = _head.load(std::memory_order_acquire);
+  const quint64 first = head > quint64(Capacity) ? head - Capacity : 0;
+
+  writer.beginArray();
+  for (quint64 index = first; index < head; ++index) {
+    const Entry& slot = _entries[index & kMask];
+
+    const quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+    const qint64 time = slot.time;
+    const quint64 address = slot.address;
+    const quint128 attribute = slot.attribute;
+    const qint64 value = slot.value;
+    const int type = slot.type;
+    const int operation = slot.operation;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence != index + 1
+        || slot.sequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+
+    writer.beginObject();
+    writer.key(QLatin1String("time"));
+    writer.value(time);
+    writer.key(QLatin1String("event"));
+    writer.value(QLatin1String(eventName(type)));
+    if (address) {
+      writer.key(QLatin1String("id"));
+      writer.value(QBluetoothAddress(address).toString());
+    }
+    const QBluetoothUuid uuid(attribute);
+    if (!uuid.isNull()) {
+      writer.key(QLatin1String("uuid"));
+      writer.value(BleUuid::toString(uuid));
+    }
+    if (operation >= 0) {
+      writer.key(QLatin1String("operation"));
+      writer.value(QLatin1String(operationName(operation)));
+    }
+    writer.key(QLatin1String("value"));
+    writer.value(value);
+    writer.endObject();
+  }
+  writer.endArray();
+}
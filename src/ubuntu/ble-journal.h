@@ -0,0 +1,100 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_JOURNAL_H
+#define BLE_JOURNAL_H
+
+#include <atomic>
+
+#include <QBluetoothUuid>
+
+#include "ble-json-writer.h"
+
+/**
+ * @brief The BleJournal class
+ *
+ * Fixed size ring of the most recent plugin events, for post-mortem
+ * diagnostics. Recording is lock-free and does not allocate, it is cheap
+ * enough to stay enabled under full notification load.
+ *
+ * Writers claim a slot with an atomic increment; every slot carries the
+ * sequence number of its event, written last, so that a snapshot skips
+ * slots overwritten while it was being taken.
+ */
+class BleJournal {
+public:
+    enum EventType {
+        ScanStarted = 1,
+        ScanStopped,
+        ConnectRequested,
+        Connected,
+        Disconnected,
+        ControllerStateChanged,
+        ControllerError,
+        ServiceStateChanged,
+        ServiceError,
+        OperationQueued,
+        OperationStarted,
+        OperationCompleted,
+        OperationFailed
+    };
+
+    // must be a power of two
+    static const int Capacity = 4096;
+
+    BleJournal();
+
+    /**
+     * Records an event.
+     * operation is a BlePeripheral::OperationType, or -1.
+     * value is the queue depth for operation events, the state or error
+     * code for state and error events.
+     */
+    void record(EventType type,
+                quint64 address,
+                const QBluetoothUuid& attribute = QBluetoothUuid(),
+                int operation = -1,
+                qint64 value = 0);
+
+    quint64 recorded() const {
+        return _head.load(std::memory_order_relaxed);
+    }
+
+    // JSON array of the events in the ring, oldest first
+    void write(BleJsonWriter& writer) const;
+
+private:
+    struct Entry {
+        // sequence number + 1 of the event, 0 while being written
+        std::atomic<quint64> sequence;
+        qint64 time;
+        quint64 address;
+        quint128 attribute;
+        qint64 value;
+        qint16 type;
+        qint16 operation;
+    };
+
+    std::atomic<quint64> _head;
+    Entry _entries[Capacity];
+};
+
+#endif // BLE_JOURNAL_H
@@ -0,0 +1,268 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-json-writer.h"
+
+#include <cmath>
+#include <cstdio>
+
+#include <QtNumeric>
+
+namespace {
+
+const char kBase64[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+const char kHex[] = "0123456789abcdef";
+
+}
+
+BleJsonWriter::BleJsonWriter(int capacity)
+  : _capacity(0),
+    _allocations(0),
+    _hasElement(0),
+    _depth(0),
+    _afterKey(false) {
+  _buffer.reserve(capacity);
+}
+
+void BleJsonWriter::reset() {
+  if (_buffer.capacity() != _capacity) {
+    // grew while writing the previous message
+    ++_allocations;
+  }
+  if (!_buffer.isDetached()) {
+    // the previous message is still referenced, writing to the buffer
+    // would copy it into a minimal one and grow again from there
+    const int capacity = _buffer.capacity();
+    _buffer = QString();
+    _buffer.reserve(capacity);
+    ++_allocations;
+  }
+  _capacity = _buffer.capacity();
+
+  // resize() keeps the allocation of an unshared string
+  _buffer.resize(0);
+  _hasElement = 0;
+  _depth = 0;
+  _afterKey = false;
+}
+
+void BleJsonWriter::separator() {
+  if (_afterKey) {
+    _afterKey = false;
+    return;
+  }
+  const quint64 bit = quint64(1) << (_depth & 63);
+  if (_hasElement & bit) {
+    _buffer.append(QLatin1Char(','));
+  }
+  _hasElement |= bit;
+}
+
+void BleJsonWriter::push() {
+  ++_depth;
+  _hasElement &= ~(quint64(1) << (_depth & 63));
+}
+
+void BleJsonWriter::pop() {
+  --_depth;
+}
+
+void BleJsonWriter::beginObject() {
+  separator();
+  _buffer.append(QLatin1Char('{'));
+  push();
+}
+
+void BleJsonWriter::endObject() {
+  pop();
+  _buffer.append(QLatin1Char('}'));
+}
+
+void BleJsonWriter::beginArray() {
+  separator();
+  _buffer.append(QLatin1Char('['));
+  push();
+}
+
+void BleJsonWriter::endArray() {
+  pop();
+  _buffer.append(QLatin1Char(']'));
+}
+
+void BleJsonWriter::key(QLatin1String name) {
+  separator();
+  _buffer.append(QLatin1Char('"'));
+  _buffer.append(name);
+  _buffer.append(QLatin1String("\":"));
+  _afterKey = true;
+}
+
+void BleJsonWriter::value(QLatin1String string) {
+  beginString();
+  appendToString(string);
+  endString();
+}
+
+void BleJsonWriter::value(const QString& string) {
+  separator();
+  _buffer.append(QLatin1Char('"'));
+  appendEscaped(string.constData(), string.size());
+  _buffer.append(QLatin1Char('"'));
+}
+
+void BleJsonWriter::value(qint64 number) {
+  separator();
+
+  char digits[21];
+  int pos = sizeof(digits);
+  quint64 magnitude = number < 0 ? quint64(0) - quint64(number)
+                                 : quint64(number);
+  do {
+    digits[--pos] = char('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude);
+  if (number < 0) {
+    digits[--pos] = '-';
+  }
+  _buffer.append(QLatin1String(digits + pos, int(sizeof(digits)) - pos));
+}
+
+void BleJsonWriter::value(double number) {
+  if (!qIsFinite(number)) {
+    null();
+    return;
+  }
+  if (number == std::floor(number) && std::fabs(number) < 1e15) {
+    value(qint64(number));
+    return;
+  }
+
+  separator();
+
+  char digits[32];
+  int size = std::snprintf(digits, sizeof(digits), "%.15g", number);
+  size = qBound(0, size, int(sizeof(digits)) - 1);
+  for (int i = 0; i < size; ++i) {
+    // snprintf follows LC_NUMERIC
+    if (digits[i] == ',') {
+      digits[i] = '.';
+    }
+  }
+  _buffer.append(QLatin1String(digits, size));
+}
+
+void BleJsonWriter::value(bool boolean) {
+  separator();
+  _buffer.append(boolean ? QLatin1String("true") : QLatin1String("false"));
+}
+
+void BleJsonWriter::null() {
+  separator();
+  _buffer.append(QLatin1String("null"));
+}
+
+void BleJsonWriter::arrayBuffer(const char *data, int size) {
+  beginObject();
+  key(QLatin1String("CDVType"));
+  value(QLatin1String("ArrayBuffer"));
+  key(QLatin1String("data"));
+  base64(data, size);
+  endObject();
+}
+
+void BleJsonWriter::base64(const char *data, int size) {
+  separator();
+  _buffer.append(QLatin1Char('"'));
+
+  const uchar *d = reinterpret_cast<const uchar *>(data);
+  int i = 0;
+  for (; i + 2 < size; i += 3) {
+    const quint32 triple = (d[i] << 16) | (d[i + 1] << 8) | d[i + 2];
+    _buffer.append(QLatin1Char(kBase64[(triple >> 18) & 0x3f]));
+    _buffer.append(QLatin1Char(kBase64[(triple >> 12) & 0x3f]));
+    _buffer.append(QLatin1Char(kBase64[(triple >> 6) & 0x3f]));
+    _buffer.append(QLatin1Char(kBase64[triple & 0x3f]));
+  }
+  if (i < size) {
+    const quint32 triple =
+      (d[i] << 16) | (i + 1 < size ? d[i + 1] << 8 : 0);
+    _buffer.append(QLatin1Char(kBase64[(triple >> 18) & 0x3f]));
+    _buffer.append(QLatin1Char(kBase64[(triple >> 12) & 0x3f]));
+    _buffer.append(i + 1 < size
+                   ? QLatin1Char(kBase64[(triple >> 6) & 0x3f])
+                   : QLatin1Char('='));
+    _buffer.append(QLatin1Char('='));
+  }
+
+  _buffer.append(QLatin1Char('"'));
+}
+
+void BleJsonWriter::beginString() {
+  separator();
+  _buffer.append(QLatin1Char('"'));
+}
+
+void BleJsonWriter::appendToString(QLatin1String fragment) {
+  for (int i = 0; i < fragment.size(); ++i) {
+    const QChar c = QLatin1Char(fragment.data()[i]);
+    appendEscaped(&c, 1);
+  }
+}
+
+void BleJsonWriter::endString() {
+  _buffer.append(QLatin1Char('"'));
+}
+
+void BleJsonWriter::appendEscaped(const QChar *chars, int size) {
+  for (int i = 0; i < size; ++i) {
+    const ushort c = chars[i].unicode();
+    switch (c) {
+    case '"':
+      _buffer.append(QLatin1String("\\\""));
+      break;
+    case '\\':
+      _buffer.append(QLatin1String("\\\\"));
+      break;
+    case '\n':
+      _buffer.append(QLatin1String("\\n"));
+      break;
+    case '\r':
+      _buffer.append(QLatin1String("\\r"));
+      break;
+    case '\t':
+      _buffer.append(QLatin1String("\\t"));
+      break;
+    default:
+      if (c < 0x20 || c == 0x2028 || c == 0x2029) {
+        // U+2028 and U+2029 are not valid in JavaScript string literals
+        _buffer.append(QLatin1String("\\u"));
+        _buffer.append(QLatin1Char(kHex[(c >> 12) & 0xf]));
+        _buffer.append(QLatin1Char(kHex[(c >> 8) & 0xf]));
+        _buffer.append(QLatin1Char(kHex[(c >> 4) & 0xf]));
+        _buffer.append(QLatin1Char(kHex[c & 0xf]));
+      } else {
+        _buffer.append(chars[i]);
+      }
+    }
+  }
+}
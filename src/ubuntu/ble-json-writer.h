@@ -0,0 +1,88 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef BLE_JSON_WRITER_H
+#define BLE_JSON_WRITER_H
+
+#include <QString>
+
+/**
+ * @brief The BleJsonWriter class
+ *
+ * Writes JSON callback messages directly into a reusable buffer, without
+ * going through QVariant and QJsonDocument. Once the buffer has grown to
+ * the size of the largest message, writing does not allocate.
+ */
+class BleJsonWriter {
+public:
+    explicit BleJsonWriter(int capacity = 256);
+
+    // Starts a new message, keeping the buffer allocation.
+    void reset();
+
+    const QString& text() const { return _buffer; }
+
+    // buffer size in characters
+    int capacity() const { return _buffer.capacity(); }
+    // buffer allocations seen by reset(), constant once the buffer fits
+    // the largest message and messages are not kept after they are sent
+    int allocations() const { return _allocations; }
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    void key(QLatin1String name);
+
+    void value(QLatin1String string);
+    void value(const QString& string);
+    void value(qint64 number);
+    void value(int number) { value(qint64(number)); }
+    void value(double number);
+    void value(bool boolean);
+    void null();
+
+    // base64 encoded string
+    void base64(const char *data, int size);
+    // {"CDVType": "ArrayBuffer", "data": base64}, see ble.js
+    void arrayBuffer(const char *data, int size);
+
+    // Appends a string value made of several fragments.
+    void beginString();
+    void appendToString(QLatin1String fragment);
+    void endString();
+
+private:
+    void separator();
+    void push();
+    void pop();
+    void appendEscaped(const QChar *chars, int size);
+
+    QString _buffer;
+    int _capacity;
+    int _allocations;
+    // bit n is set once the container at depth n has an element
+    quint64 _hasElement;
+    int _depth;
+    bool _afterKey;
+};
+
+#endif // BLE_JSON_WRITER_H
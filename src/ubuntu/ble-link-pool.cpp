@@ -0,0 +1,106 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+
+#include "ble-link-pool.h"
+
+#include "ble-json-writer.h"
+
+BleLinkPool::BleLinkPool()
+  : _maxLinks(0),
+    _clock(0),
+    _evicting(0),
+    _reused(0),
+    _opened(0),
+    _evictions(0) {
+}
+
+void BleLinkPool::setMaxLinks(int maxLinks) {
+  _maxLinks = qMax(0, maxLinks);
+}
+
+void BleLinkPool::add(int handle) {
+  _lastUsed.insert(handle, ++_clock);
+}
+
+void BleLinkPool::remove(int handle) {
+  _lastUsed.remove(handle);
+  _waiting.removeAll(handle);
+}
+
+void BleLinkPool::touch(int handle) {
+  auto it = _lastUsed.find(handle);
+  if (it == _lastUsed.end()) {
+    return;
+  }
+  if (!_waiting.contains(handle)) {
+    ++_reused;
+  }
+  *it = ++_clock;
+}
+
+/**
+ * @brief BleLinkPool::leastRecentlyUsed
+ *
+ * Scans the pooled peripherals, a few dozen at most, for the idle one
+ * used the longest time ago. A scan per eviction is cheaper than keeping
+ * a list ordered on every call.
+ *
+ * @param idle
+ * @return handle of the peripheral, 0 if none is idle
+ */
+int BleLinkPool::leastRecentlyUsed(const IdlePredicate& idle) const {
+  int oldest = 0;
+  quint64 oldestUse = 0;
+  for (auto it = _lastUsed.constBegin(); it != _lastUsed.constEnd(); ++it) {
+    if ((!oldest || it.value() < oldestUse) && idle(it.key())) {
+      oldest = it.key();
+      oldestUse = it.value();
+    }
+  }
+  return oldest;
+}
+
+void BleLinkPool::evictionStarted() {
+  ++_evicting;
+  ++_evictions;
+}
+
+void BleLinkPool::write(BleJsonWriter& writer, int links) const {
+  writer.beginObject();
+  writer.key(QLatin1String("maxConnections"));
+  writer.value(_maxLinks);
+  writer.key(QLatin1String("links"));
+  writer.value(links);
+  writer.key(QLatin1String("pooled"));
+  writer.value(_lastUsed.size() - _waiting.size());
+  writer.key(QLatin1String("waiting"));
+  writer.value(_waiting.size());
+  writer.key(QLatin1String("evicting"));
+  writer.value(_evicting);
+  writer.key(QLatin1String("reused"));
+  writer.value(qint64(_reused));
+  writer.key(QLatin1String("opened"));
+  writer.value(qint64(_opened));
+  writer.key(QLatin1String("evictions"));
+  writer.value(qint64(_evictions));
+  writer.endObject();
+}
@@ -0,0 +1,105 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_LINK_POOL_H
+#define BLE_LINK_POOL_H
+
+#include <functional>
+
+#include <QHash>
+#include <QQueue>
+#include <QString>
+
+class BleJsonWriter;
+
+/**
+ * @brief The BleLinkPool class
+ *
+ * Bookkeeping of the links opened on demand to poll a fleet of
+ * peripherals larger than the number of links the adapter holds. A GATT
+ * call on a peripheral that is not connected queues it for a link; when
+ * every link is taken, the least recently used idle pooled link is closed
+ * to make room.
+ *
+ * Peripherals are identified by their handle in the peripheral table.
+ * Links opened by connect() are not pooled and never evicted, but count
+ * against the limit.
+ */
+class BleLinkPool {
+public:
+    typedef std::function<bool(int handle)> IdlePredicate;
+
+    BleLinkPool();
+
+    // 0 disables pooling
+    int maxLinks() const { return _maxLinks; }
+    void setMaxLinks(int maxLinks);
+    bool isEnabled() const { return _maxLinks > 0; }
+
+    void add(int handle);
+    // Forgets a pooled peripheral, waiting or linked.
+    void remove(int handle);
+    bool contains(int handle) const { return _lastUsed.contains(handle); }
+    // Marks a pooled peripheral as the most recently used.
+    void touch(int handle);
+    // The least recently used pooled peripheral accepted by idle, 0 if
+    // there is none.
+    int leastRecentlyUsed(const IdlePredicate& idle) const;
+
+    // Pooled peripherals waiting for a link, in order of arrival.
+    void wait(int handle) { _waiting.enqueue(handle); }
+    int takeWaiting() { return _waiting.dequeue(); }
+    int waiting() const { return _waiting.size(); }
+
+    // Evicted links on their way down still hold their slot.
+    void evictionStarted();
+    void evictionFinished() { --_evicting; }
+    int evicting() const { return _evicting; }
+
+    void linkOpened() { ++_opened; }
+
+    // Peripheral object of the last connection to a device, returned
+    // again when it reconnects.
+    void cache(quint64 address, const QString& description) {
+        _descriptions.insert(address, description);
+    }
+    QString cached(quint64 address) const {
+        return _descriptions.value(address);
+    }
+
+    void write(BleJsonWriter& writer, int links) const;
+
+private:
+    int _maxLinks;
+    // use counter value of the last call on each pooled peripheral
+    QHash<int, quint64> _lastUsed;
+    quint64 _clock;
+    QQueue<int> _waiting;
+    int _evicting;
+    QHash<quint64, QString> _descriptions;
+
+    // calls served by a link already open
+    quint64 _reused;
+    quint64 _opened;
+    quint64 _evictions;
+};
+
+#endif // BLE_LINK_POOL_H
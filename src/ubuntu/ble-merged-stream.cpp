@@ -0,0 +1,282 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+
+#include "ble-merged-stream.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// a device clock this far behind the aligned one was reset or drifted
+const qint64 kResyncThreshold = 1000000;
+
+// samples before a long interval counts as a gap
+const quint64 kGapWarmup = 8;
+
+}
+
+BleMergedStream::BleMergedStream(const Sink& sink)
+  : _sink(sink),
+    _window(50000),
+    _timestampOffset(0),
+    _timestampSize(0),
+    _timestampUnit(1),
+    _sent(0),
+    _emitted(0),
+    _late(0),
+    _batches(0) {
+  _clock.start();
+  QObject::connect(&_timer, &QTimer::timeout, [this]() {
+      flush(_clock.nsecsElapsed() / 1000 - _window);
+    });
+}
+
+BleMergedStream::~BleMergedStream() {
+  _timer.stop();
+}
+
+bool BleMergedStream::configure(const QVariantMap& options, QString *error) {
+  bool ok = true;
+  const int window = options.value("window", 50).toInt(&ok);
+  if (!ok || window < 0) {
+    // TODO i8n
+    *error = QLatin1String("Invalid window");
+    return false;
+  }
+  const int batchInterval = options.value("batchInterval", 20).toInt(&ok);
+  if (!ok || batchInterval <= 0) {
+    // TODO i8n
+    *error = QLatin1String("Invalid batchInterval");
+    return false;
+  }
+
+  if (options.contains("timestampOffset")) {
+    _timestampOffset = options.value("timestampOffset").toInt(&ok);
+    _timestampSize = options.value("timestampSize", 4).toInt();
+    _timestampUnit = options.value("timestampUnit", 1000).toLongLong();
+    if (!ok || _timestampOffset < 0
+        || (_timestampSize != 2 && _timestampSize != 4)
+        || _timestampUnit <= 0) {
+      // TODO i8n
+      *error = QLatin1String("Invalid timestamp");
+      return false;
+    }
+  }
+
+  _window = qint64(window) * 1000;
+  _timer.start(batchInterval);
+  return true;
+}
+
+int BleMergedStream::addSource(quint64 address) {
+  Source source;
+  source.address = address;
+  _sources.append(source);
+  return _sources.size() - 1;
+}
+
+/**
+ * @brief BleMergedStream::push
+ *
+ * Timestamps a notification and holds it for the reordering window.
+ * Samples of one source keep their arrival order.
+ *
+ * @param source index returned by addSource()
+ * @param value payload
+ */
+void BleMergedStream::push(int source, const QByteArray& value) {
+  const qint64 now = _clock.nsecsElapsed() / 1000;
+  Source& s = _sources[source];
+  const qint64 time = qMax(timestamp(s, value, now), s.lastTime);
+
+  if (s.lastTime >= 0) {
+    const qint64 interval = time - s.lastTime;
+    if (s.samples > kGapWarmup && interval > 2 * s.period) {
+      ++s.gaps;
+    }
+    s.period = s.samples == 1 ? double(interval)
+                              : s.period + 0.1 * (interval - s.period);
+  }
+  const qint64 lag = now - time;
+  s.lagSum += lag;
+  s.lagMax = qMax(s.lagMax, lag);
+  ++s.samples;
+  s.lastTime = time;
+
+  if (time < _sent) {
+    ++_late;
+    return;
+  }
+  Sample sample;
+  sample.time = time;
+  sample.value = value;
+  s.queue.enqueue(sample);
+}
+
+void BleMergedStream::flushAll() {
+  flush(std::numeric_limits<qint64>::max());
+}
+
+/**
+ * @brief BleMergedStream::timestamp
+ *
+ * Time of a sample: its arrival, or the device timestamp in the payload
+ * moved onto _clock. The device clock is aligned on the sample that
+ * arrived the soonest after it was taken, the one with the smallest
+ * arrival - device time; the counter is unwrapped across overflows.
+ *
+ * @param source
+ * @param value payload
+ * @param now arrival time
+ * @return µs of _clock
+ */
+qint64 BleMergedStream::timestamp(Source& source, const QByteArray& value,
+                                  qint64 now) {
+  if (_timestampSize == 0
+      || value.size() < _timestampOffset + _timestampSize) {
+    return now;
+  }
+
+  const uchar *data =
+    reinterpret_cast<const uchar *>(value.constData()) + _timestampOffset;
+  quint32 raw = 0;
+  for (int i = 0; i < _timestampSize; ++i) {
+    raw |= quint32(data[i]) << (8 * i);
+  }
+
+  if (!source.hasTimestamp) {
+    source.hasTimestamp = true;
+    source.deviceTime = 0;
+    source.offset = now;
+  } else {
+    const quint32 delta = _timestampSize == 2
+      ? quint32(quint16(raw - source.lastRaw))
+      : raw - source.lastRaw;
+    source.deviceTime += qint64(delta) * _timestampUnit;
+  }
+  source.lastRaw = raw;
+
+  const qint64 offset = now - source.deviceTime;
+  if (offset < source.offset || offset - source.offset > kResyncThreshold) {
+    source.offset = offset;
+  }
+  return source.deviceTime + source.offset;
+}
+
+/**
+ * @brief BleMergedStream::flush
+ *
+ * Sends the samples up to watermark as one batch, merged across the
+ * sources through a heap of their oldest samples:
+ * [{"device": index, "t": ms, "value": ArrayBuffer}, ...]
+ *
+ * @param watermark µs of _clock
+ */
+void BleMergedStream::flush(qint64 watermark) {
+  auto later = [this](int a, int b) {
+    return _sources.at(a).queue.head().time > _sources.at(b).queue.head().time;
+  };
+
+  _heap.clear();
+  for (int i = 0; i < _sources.size(); ++i) {
+    if (!_sources.at(i).queue.isEmpty()) {
+      _heap.append(i);
+    }
+  }
+  std::make_heap(_heap.begin(), _heap.end(), later);
+
+  bool empty = true;
+  while (!_heap.isEmpty()) {
+    const int i = _heap.first();
+    Source& source = _sources[i];
+    if (source.queue.head().time > watermark) {
+      break;
+    }
+    std::pop_heap(_heap.begin(), _heap.end(), later);
+    _heap.removeLast();
+
+    const Sample sample = source.queue.dequeue();
+    if (empty) {
+      _writer.reset();
+      _writer.beginArray();
+      empty = false;
+    }
+    _writer.beginObject();
+    _writer.key(QLatin1String("device"));
+    _writer.value(i);
+    _writer.key(QLatin1String("t"));
+    _writer.value(sample.time / 1000.0);
+    _writer.key(QLatin1String("value"));
+    _writer.arrayBuffer(sample.value.constData(), sample.value.size());
+    _writer.endObject();
+    _sent = sample.time;
+    ++_emitted;
+
+    if (!source.queue.isEmpty()) {
+      _heap.append(i);
+      std::push_heap(_heap.begin(), _heap.end(), later);
+    }
+  }
+
+  if (!empty) {
+    _writer.endArray();
+    ++_batches;
+    _sink(_writer.text());
+  }
+}
+
+void BleMergedStream::write(BleJsonWriter& writer) const {
+  writer.beginObject();
+  writer.key(QLatin1String("window"));
+  writer.value(_window / 1000.0);
+  writer.key(QLatin1String("emitted"));
+  writer.value(qint64(_emitted));
+  writer.key(QLatin1String("late"));
+  writer.value(qint64(_late));
+  writer.key(QLatin1String("batches"));
+  writer.value(qint64(_batches));
+  writer.key(QLatin1String("devices"));
+  writer.beginArray();
+  Q_FOREACH(const Source& source, _sources) {
+    writer.beginObject();
+    writer.key(QLatin1String("samples"));
+    writer.value(qint64(source.samples));
+    writer.key(QLatin1String("held"));
+    writer.value(source.queue.size());
+    writer.key(QLatin1String("lag"));
+    writer.beginObject();
+    writer.key(QLatin1String("mean"));
+    writer.value(source.samples
+                 ? source.lagSum / 1000.0 / source.samples : 0.0);
+    writer.key(QLatin1String("max"));
+    writer.value(source.lagMax / 1000.0);
+    writer.endObject();
+    writer.key(QLatin1String("period"));
+    writer.value(source.period / 1000.0);
+    writer.key(QLatin1String("gaps"));
+    writer.value(qint64(source.gaps));
+    writer.endObject();
+  }
+  writer.endArray();
+  writer.endObject();
+}
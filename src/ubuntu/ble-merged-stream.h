@@ -0,0 +1,134 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_MERGED_STREAM_H
+#define BLE_MERGED_STREAM_H
+
+#include <functional>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QString>
+#include <QTimer>
+#include <QVariant>
+#include <QVector>
+
+#include "ble-json-writer.h"
+
+/**
+ * @brief The BleMergedStream class
+ *
+ * Notifications of one characteristic on several peripherals, merged into
+ * a single time ordered stream. Each notification is timestamped on
+ * arrival with a monotonic clock, or from a timestamp carried in the
+ * payload aligned to that clock. Samples are held for a reordering window
+ * and then merged across the devices, oldest first, into batches.
+ *
+ * A sample arriving after samples later than it were sent is late: it is
+ * dropped and counted, the window bounds the reordering.
+ */
+class BleMergedStream {
+public:
+    typedef std::function<void(const QString& message)> Sink;
+
+    explicit BleMergedStream(const Sink& sink);
+    ~BleMergedStream();
+
+    /**
+     * Accepted options, all optional:
+     *   window: reordering window in ms, 50 by default
+     *   batchInterval: ms between batches, 20 by default
+     *   timestampOffset, timestampSize, timestampUnit: the payload carries
+     *     a little endian counter of timestampSize bytes (2 or 4) at
+     *     timestampOffset, in units of timestampUnit µs
+     */
+    bool configure(const QVariantMap& options, QString *error);
+
+    // Returns the index of the device in the batches.
+    int addSource(quint64 address);
+    int sourceCount() const { return _sources.size(); }
+    quint64 address(int source) const { return _sources.at(source).address; }
+
+    // A notification of the source, timestamped now.
+    void push(int source, const QByteArray& value);
+    // Sends every held sample.
+    void flushAll();
+
+    void write(BleJsonWriter& writer) const;
+
+private:
+    struct Sample {
+        // µs of _clock
+        qint64 time;
+        QByteArray value;
+    };
+
+    struct Source {
+        Source()
+          : address(0), lastTime(-1), hasTimestamp(false), lastRaw(0),
+            deviceTime(0), offset(0), period(0), samples(0), gaps(0),
+            lagSum(0), lagMax(0) {}
+
+        quint64 address;
+        QQueue<Sample> queue;
+        qint64 lastTime;
+
+        // payload timestamp state, µs
+        bool hasTimestamp;
+        quint32 lastRaw;
+        qint64 deviceTime;
+        // smallest arrival - device time seen, the device clock in _clock
+        qint64 offset;
+
+        // moving average of the sample interval in µs
+        double period;
+        quint64 samples;
+        quint64 gaps;
+        qint64 lagSum;
+        qint64 lagMax;
+    };
+
+    qint64 timestamp(Source& source, const QByteArray& value, qint64 now);
+    void flush(qint64 watermark);
+
+    Sink _sink;
+    QElapsedTimer _clock;
+    QTimer _timer;
+    BleJsonWriter _writer;
+
+    qint64 _window;
+    int _timestampOffset;
+    int _timestampSize;
+    qint64 _timestampUnit;
+
+    QVector<Source> _sources;
+    // heap of the sources with samples, by time of their oldest sample
+    QVector<int> _heap;
+    // time of the last sample sent
+    qint64 _sent;
+
+    quint64 _emitted;
+    quint64 _late;
+    quint64 _batches;
+};
+
+#endif // BLE_MERGED_STREAM_H
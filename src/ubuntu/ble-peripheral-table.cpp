@@ -0,0 +1,158 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-peripheral-table.h"
+
+#include "ble-peripheral.h"
+
+namespace {
+
+int hexDigit(ushort c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// positive decimal number of at most 9 digits, 0 otherwise
+int parseHandle(const QString& text) {
+  if (text.isEmpty() || text.size() > 9) {
+    return 0;
+  }
+  int value = 0;
+  for (int i = 0; i < text.size(); ++i) {
+    const ushort c = text.at(i).unicode();
+    if (c < '0' || c > '9') {
+      return 0;
+    }
+    value = value * 10 + (c - '0');
+  }
+  return value;
+}
+
+}
+
+BlePeripheralTable::BlePeripheralTable()
+  : _serial(0) {
+}
+
+BlePeripheralTable::~BlePeripheralTable() {
+  // emptied first, peripherals fail their operations when deleted
+  const QVector<BlePeripheral *> all = peripherals();
+  for (int i = 0; i < Capacity; ++i) {
+    _entries[i].peripheral = Q_NULLPTR;
+  }
+  _handles.clear();
+  qDeleteAll(all);
+}
+
+/**
+ * @brief BlePeripheralTable::insert
+ *
+ * Adds a peripheral, which must not be in the table yet, and sets its
+ * handle.
+ *
+ * @param peripheral
+ * @return the handle, 0 if all entries are in use
+ */
+BlePeripheralTable::Handle BlePeripheralTable::insert(
+    BlePeripheral *peripheral) {
+  for (int i = 0; i < Capacity; ++i) {
+    Entry& e = _entries[i];
+    if (e.peripheral) {
+      continue;
+    }
+
+    // the serial stays positive and non-zero, so handles do too
+    _serial = (_serial + 1) & (0x7fffffff >> IndexBits);
+    if (_serial == 0) {
+      _serial = 1;
+    }
+    e.handle = (_serial << IndexBits) | i;
+    e.peripheral = peripheral;
+    _handles.insert(peripheral->address(), e.handle);
+    peripheral->setHandle(e.handle);
+    return e.handle;
+  }
+  return 0;
+}
+
+BlePeripheral *BlePeripheralTable::take(Handle handle) {
+  Entry& e = _entries[handle & (Capacity - 1)];
+  if (e.handle != handle || !e.peripheral) {
+    return Q_NULLPTR;
+  }
+
+  BlePeripheral *peripheral = e.peripheral;
+  _handles.remove(peripheral->address());
+  e.peripheral = Q_NULLPTR;
+  // keeps the handle, stale handles must not match a free entry either
+  return peripheral;
+}
+
+BlePeripheral *BlePeripheralTable::find(const QString& deviceId) const {
+  const Handle handle = parseHandle(deviceId);
+  if (handle) {
+    return find(handle);
+  }
+  const quint64 address = parseAddress(deviceId);
+  return address ? findAddress(address) : Q_NULLPTR;
+}
+
+QVector<BlePeripheral *> BlePeripheralTable::peripherals() const {
+  QVector<BlePeripheral *> result;
+  result.reserve(size());
+  for (int i = 0; i < Capacity; ++i) {
+    if (_entries[i].peripheral) {
+      result.append(_entries[i].peripheral);
+    }
+  }
+  return result;
+}
+
+quint64 BlePeripheralTable::parseAddress(const QString& text) {
+  // XX:XX:XX:XX:XX:XX
+  if (text.size() != 17) {
+    return 0;
+  }
+  quint64 address = 0;
+  for (int i = 0; i < 17; ++i) {
+    const ushort c = text.at(i).unicode();
+    if (i % 3 == 2) {
+      if (c != ':') {
+        return 0;
+      }
+      continue;
+    }
+    const int digit = hexDigit(c);
+    if (digit < 0) {
+      return 0;
+    }
+    address = (address << 4) | quint64(digit);
+  }
+  return address;
+}
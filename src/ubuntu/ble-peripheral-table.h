@@ -0,0 +1,87 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_PERIPHERAL_TABLE_H
+#define BLE_PERIPHERAL_TABLE_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+class BlePeripheral;
+
+/**
+ * @brief The BlePeripheralTable class
+ *
+ * The connected peripherals, addressed by a small integer handle or by
+ * their MAC address. A handle is the index of the peripheral in the table
+ * tagged with a serial number, so it resolves without hashing and a
+ * handle of a disconnected peripheral never finds its successor.
+ *
+ * The table owns the peripherals.
+ */
+class BlePeripheralTable {
+public:
+    typedef int Handle;
+
+    static const int IndexBits = 8;
+    static const int Capacity = 1 << IndexBits;
+
+    BlePeripheralTable();
+    ~BlePeripheralTable();
+
+    // Returns the handle of peripheral, 0 if the table is full.
+    Handle insert(BlePeripheral *peripheral);
+    // Removes a peripheral and hands it back, Q_NULLPTR if not found.
+    BlePeripheral *take(Handle handle);
+
+    BlePeripheral *find(Handle handle) const {
+        const Entry& e = _entries[handle & (Capacity - 1)];
+        return e.handle == handle ? e.peripheral : Q_NULLPTR;
+    }
+    BlePeripheral *findAddress(quint64 address) const {
+        return find(_handles.value(address));
+    }
+    // deviceId is a handle or a MAC address as in "00:11:22:AA:BB:CC"
+    BlePeripheral *find(const QString& deviceId) const;
+
+    int size() const { return _handles.size(); }
+    bool isEmpty() const { return _handles.isEmpty(); }
+    QVector<BlePeripheral *> peripherals() const;
+
+    // MAC address as a number, 0 if text is not one
+    static quint64 parseAddress(const QString& text);
+
+private:
+    struct Entry {
+        Entry() : handle(0), peripheral(Q_NULLPTR) {}
+
+        Handle handle;
+        BlePeripheral *peripheral;
+    };
+
+    Entry _entries[Capacity];
+    QHash<quint64, Handle> _handles;
+    // tags the next handle
+    int _serial;
+};
+
+#endif // BLE_PERIPHERAL_TABLE_H
@@ -0,0 +1,865 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-peripheral.h"
+
+#include "ble-journal.h"
+#include "ble-recorder.h"
+#include "ble-replay.h"
+#include "ble-subscription.h"
+#include "ble-timer-wheel.h"
+#include "ble-trace.h"
+
+#include <QTimer>
+
+#include <QLowEnergyCharacteristic>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
+#include <QLowEnergyConnectionParameters>
+#endif
+#include <QLowEnergyDescriptor>
+
+namespace {
+
+QString serviceErrorToString(QLowEnergyService::ServiceError error) {
+  switch(error) {
+  case QLowEnergyService::NoError:
+    return QLatin1String("No Error");
+  case QLowEnergyService::OperationError:
+    return QLatin1String("Operation Error");
+  case QLowEnergyService::CharacteristicWriteError:
+    return QLatin1String("Characteristic Write Error");
+  case QLowEnergyService::DescriptorWriteError:
+    return QLatin1String("Descriptor Write Error");
+  case QLowEnergyService::CharacteristicReadError:
+    return QLatin1String("Characteristic Read Error");
+  case QLowEnergyService::DescriptorReadError:
+    return QLatin1String("Descriptor Read Error");
+  default:
+    break;
+  }
+  return QLatin1String("Unknown");
+}
+
+}
+
+BlePeripheral::BlePeripheral(const QBluetoothAddress& address,
+                             QObject *parent)
+  : QObject(parent),
+    _controller(new QLowEnergyController(address, this)),
+    _address(address.toUInt64()),
+    _handle(0),
+    _recorder(Q_NULLPTR),
+    _journal(Q_NULLPTR),
+    _trace(Q_NULLPTR),
+    _replay(Q_NULLPTR),
+    _timers(Q_NULLPTR),
+    _currentService(Q_NULLPTR),
+    _currentStarted(0),
+    _sequence(0),
+    _timeoutHandle(0),
+    _abortedTransaction(0),
+    _busy(false),
+    _dispatching(false),
+    _ready(true) {
+  for (int& timeout : _timeouts) {
+    timeout = 0;
+  }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
+  QObject::connect(_controller, &QLowEnergyController::connectionUpdated,
+                   this,
+                   [this](const QLowEnergyConnectionParameters& parameters) {
+                     // the range collapses to the interval in use
+                     _link.interval = parameters.minimumInterval();
+                     _link.latency = parameters.latency();
+                     _link.supervisionTimeout =
+                       parameters.supervisionTimeout();
+                     linkUpdated();
+                   });
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+  QObject::connect(_controller, &QLowEnergyController::connected,
+                   this, [this]() {
+                     _link.mtu = _controller->mtu();
+                     _link.mtuKnown = true;
+                   });
+  QObject::connect(_controller, &QLowEnergyController::mtuChanged,
+                   this, [this](int mtu) {
+                     _link.mtu = mtu;
+                     _link.mtuKnown = true;
+                     linkUpdated();
+                   });
+#endif
+}
+
+BlePeripheral::~BlePeripheral() {
+  // TODO i8n
+  failAll(QLatin1String("Peripheral disconnected"));
+  qDeleteAll(_subscriptions);
+}
+
+/**
+ * @brief BlePeripheral::enqueue
+ *
+ * Appends an operation to the queue. Operations run one at a time in
+ * order, the next one starts when the previous one completed or failed.
+ *
+ * @param operation
+ */
+void BlePeripheral::enqueue(const Operation& operation) {
+  if (operation.transaction
+      && operation.transaction == _abortedTransaction) {
+    // an earlier operation of the transaction failed while it was being
+    // queued
+    if (operation.failure) {
+      // TODO i8n
+      operation.failure(QLatin1String("Transaction aborted"));
+    }
+    return;
+  }
+
+  _queue.enqueue(operation);
+  journal(BleJournal::OperationQueued, operation.characteristic,
+          operation.type, _queue.size());
+  next();
+}
+
+/**
+ * @brief BlePeripheral::cancelAll
+ *
+ * Fails the current operation, the queued ones and the requests waiting
+ * for a service discovery. A late answer of the peripheral to the
+ * current operation is ignored.
+ *
+ * @param error reported to the failure callbacks
+ */
+void BlePeripheral::cancelAll(const QString& error) {
+  const bool dispatching = _dispatching;
+  failAll(error);
+
+  for (auto it = _services.begin(); it != _services.end(); ++it) {
+    const QList<ServiceWaiter> waiting = it->waiting;
+    it->waiting.clear();
+    Q_FOREACH(const ServiceWaiter& waiter, waiting) {
+      waiter.failure(error);
+    }
+  }
+
+  _dispatching = dispatching;
+}
+
+void BlePeripheral::linkUpdated() {
+  ++_link.updates;
+  if (_linkChanged) {
+    _linkChanged();
+  }
+}
+
+void BlePeripheral::setReady(bool ready) {
+  _ready = ready;
+  next();
+}
+
+void BlePeripheral::setTimeout(OperationType type, int timeout) {
+  _timeouts[type] = qMax(0, timeout);
+}
+
+/**
+ * @brief BlePeripheral::setJournal
+ *
+ * Records controller state changes and errors, service state changes and
+ * errors and the operations of the queue into journal.
+ *
+ * @param journal
+ */
+void BlePeripheral::setJournal(BleJournal *journal) {
+  _journal = journal;
+
+  QObject::connect(_controller,
+                   &QLowEnergyController::stateChanged,
+                   this,
+                   [=](QLowEnergyController::ControllerState state) {
+                     this->journal(BleJournal::ControllerStateChanged,
+                                   QBluetoothUuid(), -1, state);
+                   });
+
+  void (QLowEnergyController::* controllerErrorMethodPtr)(
+        QLowEnergyController::Error)
+    = &QLowEnergyController::error;
+  QObject::connect(_controller,
+                   controllerErrorMethodPtr,
+                   this,
+                   [=](QLowEnergyController::Error error) {
+                     this->journal(BleJournal::ControllerError,
+                                   QBluetoothUuid(), -1, error);
+                   });
+}
+
+void BlePeripheral::journal(int type, const QBluetoothUuid& attribute,
+                            int operation, qint64 value) {
+  if (_journal) {
+    _journal->record(BleJournal::EventType(type), _address, attribute,
+                     operation, value);
+  }
+}
+
+/**
+ * @brief BlePeripheral::withService
+ *
+ * Calls ready with the cached service object once its details are
+ * discovered. Service objects are created and discovered on first use.
+ *
+ * @param uuid service UUID
+ * @param ready called with the discovered service, possibly synchronously
+ * @param failure called if the service can not be discovered
+ */
+void BlePeripheral::withService(const QBluetoothUuid& uuid,
+                                const ServiceCallback& ready,
+                                const ErrorCallback& failure) {
+  ServiceEntry& entry = _services[uuid];
+
+  if (!entry.service) {
+    QLowEnergyService *service =
+      _controller->createServiceObject(uuid, this);
+    if (!service) {
+      _services.remove(uuid);
+      // TODO i8n
+      failure(QLatin1String("Could not create low energy service object"));
+      return;
+    }
+    entry.service = service;
+
+    QObject::connect(service,
+                     &QLowEnergyService::stateChanged,
+                     this,
+                     [=](QLowEnergyService::ServiceState ns) {
+                       serviceStateChanged(uuid, ns);
+                     });
+    QObject::connect(service,
+                     &QLowEnergyService::characteristicRead,
+                     this,
+                     [=](const QLowEnergyCharacteristic& c,
+                         const QByteArray& value) {
+                       if (takeStaleAnswer(service, ReadCharacteristic, c.uuid())) {
+                         return;
+                       }
+                       if (isCurrent(service, c.uuid())
+                           && _current.type == ReadCharacteristic) {
+                         complete(value);
+                       }
+                     });
+    QObject::connect(service,
+                     &QLowEnergyService::characteristicWritten,
+                     this,
+                     [=](const QLowEnergyCharacteristic& c,
+                         const QByteArray& value) {
+                       if (takeStaleAnswer(service, WriteCharacteristic, c.uuid())) {
+                         return;
+                       }
+                       if (isCurrent(service, c.uuid())
+                           && _current.type == WriteCharacteristic) {
+                         complete(value);
+                       }
+                     });
+    QObject::connect(service,
+                     &QLowEnergyService::descriptorRead,
+                     this,
+                     [=](const QLowEnergyDescriptor& d,
+                         const QByteArray& value) {
+                       if (takeStaleAnswer(service, ReadDescriptor, d.uuid())) {
+                         return;
+                       }
+                       if (isCurrentDescriptor(service, d.uuid())
+                           && _current.type == ReadDescriptor) {
+                         complete(value);
+                       }
+                     });
+    QObject::connect(service,
+                     &QLowEnergyService::descriptorWritten,
+                     this,
+                     [=](const QLowEnergyDescriptor& d,
+                         const QByteArray& value) {
+                       if (takeStaleAnswer(service, WriteDescriptor, d.uuid())) {
+                         return;
+                       }
+                       if (isCurrentDescriptor(service, d.uuid())
+                           && _current.type == WriteDescriptor) {
+                         complete(value);
+                       }
+                     });
+    QObject::connect(service,
+                     &QLowEnergyService::characteristicChanged,
+                     this,
+                     [=](const QLowEnergyCharacteristic& c,
+                         const QByteArray& value) {
+                       notified(uuid, c.uuid(), value);
+                     });
+
+    void (QLowEnergyService::* serviceErrorMethodPtr)(
+          QLowEnergyService::ServiceError)
+      = &QLowEnergyService::error;
+    QObject::connect(service,
+                     serviceErrorMethodPtr,
+                     this,
+                     [=](QLowEnergyService::ServiceError error) {
+                       serviceError(service, error);
+                     });
+  }
+
+  switch (entry.service->state()) {
+  case QLowEnergyService::ServiceDiscovered:
+    ready(entry.service);
+    return;
+  case QLowEnergyService::DiscoveryRequired:
+    entry.waiting.append(ServiceWaiter { ready, failure });
+    entry.service->discoverDetails();
+    return;
+  case QLowEnergyService::DiscoveringServices:
+    entry.waiting.append(ServiceWaiter { ready, failure });
+    return;
+  default:
+    break;
+  }
+  // TODO i8n
+  failure(QLatin1String("Device not connected or closing"));
+}
+
+/**
+ * @brief BlePeripheral::subscribe
+ *
+ * Enables notifications, or indications if the characteristic does not
+ * notify, and routes the changed values to subscription.
+ *
+ * @param service service UUID
+ * @param characteristic characteristic UUID
+ * @param subscription receives the notifications
+ * @param success called once the peripheral enabled notifications
+ * @param failure called if notifications could not be enabled
+ */
+void BlePeripheral::subscribe(const QBluetoothUuid& service,
+                              const QBluetoothUuid& characteristic,
+                              BleSubscription *subscription,
+                              const SuccessCallback& success,
+                              const ErrorCallback& failure) {
+  const CharacteristicKey key(service, characteristic);
+  BleSubscription *previous = _subscriptions.take(key);
+  if (previous) {
+    previous->flush();
+    delete previous;
+  }
+  subscription->setTimerWheel(_timers);
+  _subscriptions.insert(key, subscription);
+
+  auto configure = [=](QLowEnergyCharacteristic::PropertyTypes properties) {
+    Operation operation;
+    operation.type = WriteDescriptor;
+    operation.service = service;
+    operation.characteristic = characteristic;
+    operation.descriptor =
+      QBluetoothUuid(QBluetoothUuid::ClientCharacteristicConfiguration);
+    if (properties.testFlag(QLowEnergyCharacteristic::Notify)) {
+      operation.value = QByteArray::fromHex("0100");
+    } else if (properties.testFlag(QLowEnergyCharacteristic::Indicate)) {
+      operation.value = QByteArray::fromHex("0200");
+    } else {
+      if (_subscriptions.value(key) == subscription) {
+        delete _subscriptions.take(key);
+      }
+      // TODO i8n
+      failure(QLatin1String("Characteristic does not notify"));
+      return;
+    }
+    operation.success = success;
+    operation.failure = [=](const QString& error) {
+      if (_subscriptions.value(key) == subscription) {
+        delete _subscriptions.take(key);
+      }
+      failure(error);
+    };
+    if (_submit) {
+      _submit(operation);
+    } else {
+      enqueue(operation);
+    }
+  };
+
+  if (_replay) {
+    // the trace holds the outcome of the descriptor write
+    configure(QLowEnergyCharacteristic::Notify);
+    return;
+  }
+
+  withService(
+      service,
+      [=](QLowEnergyService *s) {
+        configure(s->characteristic(characteristic).properties());
+      },
+      [=](const QString& error) {
+        if (_subscriptions.value(key) == subscription) {
+          delete _subscriptions.take(key);
+        }
+        failure(error);
+      });
+}
+
+/**
+ * @brief BlePeripheral::unsubscribe
+ *
+ * Drops the subscription of a characteristic and disables its
+ * notifications.
+ *
+ * @param service service UUID
+ * @param characteristic characteristic UUID
+ * @param success called once the peripheral disabled notifications
+ * @param failure called if notifications could not be disabled
+ * @return false if the characteristic has no subscription
+ */
+bool BlePeripheral::unsubscribe(const QBluetoothUuid& service,
+                                const QBluetoothUuid& characteristic,
+                                const SuccessCallback& success,
+                                const ErrorCallback& failure) {
+  BleSubscription *subscription =
+    _subscriptions.take(CharacteristicKey(service, characteristic));
+  if (!subscription) {
+    return false;
+  }
+  // the last window is reported before notifications stop
+  subscription->flush();
+  delete subscription;
+
+  Operation operation;
+  operation.type = WriteDescriptor;
+  operation.service = service;
+  operation.characteristic = characteristic;
+  operation.descriptor =
+    QBluetoothUuid(QBluetoothUuid::ClientCharacteristicConfiguration);
+  operation.value = QByteArray::fromHex("0000");
+  operation.success = success;
+  operation.failure = failure;
+  if (_submit) {
+    _submit(operation);
+  } else {
+    enqueue(operation);
+  }
+  return true;
+}
+
+/**
+ * @brief BlePeripheral::setReplay
+ *
+ * Turns the peripheral into a simulated one: operations are answered by
+ * replay and notifications come from its timeline.
+ *
+ * @param replay
+ */
+void BlePeripheral::setReplay(BleReplay *replay) {
+  _replay = replay;
+  QObject::connect(replay,
+                   &BleReplay::notification,
+                   this,
+                   [=](quint64 address,
+                       const QBluetoothUuid& service,
+                       const QBluetoothUuid& characteristic,
+                       const QByteArray& value) {
+                     if (address == _address) {
+                       notified(service, characteristic, value);
+                     }
+                   });
+}
+
+void BlePeripheral::notified(const QBluetoothUuid& service,
+                             const QBluetoothUuid& characteristic,
+                             const QByteArray& value) {
+  if (_recorder && _recorder->isRecording()) {
+    _recorder->record(_address, service, characteristic, value);
+  }
+  if (_trace) {
+    _trace->notification(_address, service, characteristic, value);
+  }
+
+  BleSubscription *subscription =
+    _subscriptions.value(CharacteristicKey(service, characteristic));
+  if (subscription) {
+    subscription->deliver(value, _messages);
+  }
+}
+
+void BlePeripheral::serviceStateChanged(const QBluetoothUuid& uuid,
+                                        QLowEnergyService::ServiceState state) {
+  journal(BleJournal::ServiceStateChanged, uuid, -1, state);
+
+  if (state != QLowEnergyService::ServiceDiscovered
+      && state != QLowEnergyService::InvalidService) {
+    return;
+  }
+
+  auto it = _services.find(uuid);
+  if (it == _services.end()) {
+    return;
+  }
+
+  QLowEnergyService *service = it->service;
+  const QList<ServiceWaiter> waiting = it->waiting;
+  it->waiting.clear();
+
+  if (state == QLowEnergyService::InvalidService) {
+    // the link is gone, so are the answers still expected
+    for (int i = _staleAnswers.size() - 1; i >= 0; --i) {
+      if (_staleAnswers.at(i).service == service) {
+        _staleAnswers.removeAt(i);
+      }
+    }
+  }
+
+  Q_FOREACH(const ServiceWaiter& waiter, waiting) {
+    if (state == QLowEnergyService::ServiceDiscovered) {
+      waiter.ready(service);
+    } else {
+      // TODO i8n
+      waiter.failure(QLatin1String("Device not connected or closing"));
+    }
+  }
+}
+
+void BlePeripheral::serviceError(QLowEnergyService *service,
+                                 QLowEnergyService::ServiceError error) {
+  journal(BleJournal::ServiceError, service->serviceUuid(), -1, error);
+
+  // requests are answered in order, the error is the one of the oldest
+  // request that timed out on this service
+  for (int i = 0; i < _staleAnswers.size(); ++i) {
+    if (_staleAnswers.at(i).service == service) {
+      _staleAnswers.removeAt(i);
+      return;
+    }
+  }
+
+  if (_busy && _currentService == service) {
+    fail(serviceErrorToString(error));
+  }
+}
+
+void BlePeripheral::next() {
+  if (_dispatching || !_ready) {
+    return;
+  }
+  _dispatching = true;
+
+  // operations may complete synchronously, loop rather than recurse
+  while (!_busy && !_queue.isEmpty()) {
+    _busy = true;
+    _current = _queue.dequeue();
+    _currentService = Q_NULLPTR;
+    _currentStarted = _trace ? _trace->now() : 0;
+    ++_sequence;
+    journal(BleJournal::OperationStarted, _current.characteristic,
+            _current.type, _queue.size());
+
+    const quint64 sequence = _sequence;
+    const int timeout = _current.timeout >= 0
+      ? _current.timeout
+      : _timeouts[_current.type];
+    if (_timers && timeout > 0) {
+      _timeoutHandle = _timers->schedule(timeout, [this, sequence]() {
+          _timeoutHandle = 0;
+          if (_busy && _sequence == sequence) {
+            if (_currentService
+                && _current.type != WriteCharacteristicWithoutResponse) {
+              // the stack answers the request late, if ever, and that
+              // answer must not complete a later operation
+              const StaleAnswer stale = {
+                _currentService,
+                _current.type,
+                _current.type == ReadDescriptor
+                  || _current.type == WriteDescriptor
+                  ? _current.descriptor : _current.characteristic
+              };
+              _staleAnswers.append(stale);
+            }
+            // TODO i8n
+            fail(QLatin1String("Operation timed out"));
+          }
+        });
+    }
+
+    if (_replay) {
+      simulate();
+      continue;
+    }
+
+    // the operation may have timed out or been cancelled by the time
+    // the service is discovered
+    withService(_current.service,
+                [this, sequence](QLowEnergyService *service) {
+                  if (_busy && _sequence == sequence) {
+                    execute(service);
+                  }
+                },
+                [this, sequence](const QString& error) {
+                  if (_busy && _sequence == sequence) {
+                    fail(error);
+                  }
+                });
+  }
+
+  _dispatching = false;
+}
+
+void BlePeripheral::execute(QLowEnergyService *service) {
+  _currentService = service;
+
+  const QLowEnergyCharacteristic characteristic =
+    service->characteristic(_current.characteristic);
+  if (!characteristic.isValid()) {
+    // TODO i8n
+    fail(QLatin1String("Characteristic not found"));
+    return;
+  }
+
+  switch (_current.type) {
+  case ReadCharacteristic:
+    service->readCharacteristic(characteristic);
+    return;
+
+  case WriteCharacteristic:
+    if (!characteristic.properties().testFlag(
+            QLowEnergyCharacteristic::Write)) {
+      // TODO i8n
+      fail(QLatin1String("Characteristic not writable"));
+      return;
+    }
+    service->writeCharacteristic(characteristic, _current.value);
+    return;
+
+  case WriteCharacteristicWithoutResponse: {
+    // no acknowledgement, done once handed over to the stack
+    const int payload = maxWritePayload();
+    if (!_link.mtuKnown || _current.value.size() <= payload) {
+      // without a reported MTU the stack is the one to know whether the
+      // value fits
+      service->writeCharacteristic(characteristic, _current.value,
+                                   QLowEnergyService::WriteWithoutResponse);
+      ++_link.packets;
+    } else if (!_current.split) {
+      // TODO i8n
+      fail(QString("Value longer than %1 bytes, the MTU minus 3")
+             .arg(payload));
+      return;
+    } else {
+      // every write replaces the value, the peripheral has to put the
+      // pieces back together
+      for (int offset = 0; offset < _current.value.size();
+           offset += payload) {
+        service->writeCharacteristic(characteristic,
+                                     _current.value.mid(offset, payload),
+                                     QLowEnergyService::WriteWithoutResponse);
+        ++_link.packets;
+      }
+    }
+    complete(_current.value);
+    return;
+  }
+
+  case ReadDescriptor:
+  case WriteDescriptor: {
+    const QLowEnergyDescriptor descriptor =
+      characteristic.descriptor(_current.descriptor);
+    if (!descriptor.isValid()) {
+      // TODO i8n
+      fail(QLatin1String("Descriptor not found"));
+      return;
+    }
+    if (_current.type == ReadDescriptor) {
+      service->readDescriptor(descriptor);
+    } else {
+      service->writeDescriptor(descriptor, _current.value);
+    }
+    return;
+  }
+  }
+}
+
+/**
+ * @brief BlePeripheral::simulate
+ *
+ * Answers the current operation with the outcome recorded in the replayed
+ * trace, after the recorded duration.
+ */
+void BlePeripheral::simulate() {
+  const BleTrace::Event *event = _replay->response(_address,
+                                                   _current.type,
+                                                   _current.service,
+                                                   _current.characteristic,
+                                                   _current.descriptor);
+  if (!event) {
+    // TODO i8n
+    fail(QLatin1String("Operation not in trace"));
+    return;
+  }
+
+  const quint64 sequence = _sequence;
+  const bool ok = event->ok;
+  const QByteArray value = event->value;
+  const QString error = event->text;
+  QTimer::singleShot(_replay->delay(event->duration), this, [=]() {
+      if (!_busy || _sequence != sequence) {
+        return;
+      }
+      if (!ok) {
+        fail(error);
+      } else if (_current.type == ReadCharacteristic
+                 || _current.type == ReadDescriptor) {
+        complete(value);
+      } else {
+        complete(_current.value);
+      }
+    });
+}
+
+bool BlePeripheral::isCurrent(QLowEnergyService *service,
+                              const QBluetoothUuid& characteristic) const {
+  return _busy
+    && _currentService == service
+    && _current.characteristic == characteristic;
+}
+
+/**
+ * @brief BlePeripheral::takeStaleAnswer
+ *
+ * Whether an answer of the stack is the late one of an operation that
+ * timed out, rather than the answer of the current operation on the same
+ * attribute. The stale answer is forgotten once it arrived.
+ *
+ * @param service
+ * @param type
+ * @param attribute characteristic, or descriptor for descriptor operations
+ */
+bool BlePeripheral::takeStaleAnswer(QLowEnergyService *service,
+                                    OperationType type,
+                                    const QBluetoothUuid& attribute) {
+  for (int i = 0; i < _staleAnswers.size(); ++i) {
+    const StaleAnswer& stale = _staleAnswers.at(i);
+    if (stale.service == service
+        && stale.type == type
+        && stale.attribute == attribute) {
+      _staleAnswers.removeAt(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BlePeripheral::isCurrentDescriptor(QLowEnergyService *service,
+                                        const QBluetoothUuid& descriptor) const {
+  return _busy
+    && _currentService == service
+    && _current.descriptor == descriptor;
+}
+
+void BlePeripheral::traceOperation(bool ok, const QByteArray& value,
+                                   const QString& error) {
+  if (_trace) {
+    _trace->operation(_address, _currentStarted, _current.type,
+                      _current.service, _current.characteristic,
+                      _current.descriptor, ok, value, error);
+  }
+}
+
+void BlePeripheral::complete(const QByteArray& value) {
+  traceOperation(true, value, QString());
+  journal(BleJournal::OperationCompleted, _current.characteristic,
+          _current.type, _queue.size());
+
+  const SuccessCallback success = _current.success;
+  finish();
+
+  if (success) {
+    success(value);
+  }
+  next();
+}
+
+void BlePeripheral::fail(const QString& error) {
+  traceOperation(false, QByteArray(), error);
+  journal(BleJournal::OperationFailed, _current.characteristic,
+          _current.type, _queue.size());
+
+  const ErrorCallback failure = _current.failure;
+  const quint64 transaction = _current.transaction;
+  finish();
+
+  // taken out before the callbacks run, so that none of them starts
+  QList<Operation> aborted;
+  if (transaction) {
+    _abortedTransaction = transaction;
+    aborted = takeTransaction(transaction);
+  }
+
+  if (failure) {
+    failure(error);
+  }
+  Q_FOREACH(const Operation& operation, aborted) {
+    if (operation.failure) {
+      // TODO i8n
+      operation.failure(QLatin1String("Transaction aborted"));
+    }
+  }
+  next();
+}
+
+QList<BlePeripheral::Operation> BlePeripheral::takeTransaction(
+    quint64 transaction) {
+  QList<Operation> taken;
+  for (auto it = _queue.begin(); it != _queue.end(); ) {
+    if (it->transaction == transaction) {
+      taken.append(*it);
+      it = _queue.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return taken;
+}
+
+void BlePeripheral::finish() {
+  if (_timeoutHandle) {
+    _timers->cancel(_timeoutHandle);
+    _timeoutHandle = 0;
+  }
+  _current = Operation();
+  _currentService = Q_NULLPTR;
+  _busy = false;
+}
+
+void BlePeripheral::failAll(const QString& error) {
+  // prevents queued operations from starting
+  _dispatching = true;
+
+  if (_busy) {
+    fail(error);
+  }
+  while (!_queue.isEmpty()) {
+    const Operation operation = _queue.dequeue();
+    if (operation.failure) {
+      operation.failure(error);
+    }
+  }
+}
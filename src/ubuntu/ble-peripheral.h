@@ -0,0 +1,292 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef BLE_PERIPHERAL_H
+#define BLE_PERIPHERAL_H
+
+#include <functional>
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QQueue>
+#include <QString>
+
+#include <QBluetoothAddress>
+#include <QBluetoothUuid>
+#include <QLowEnergyController>
+#include <QLowEnergyService>
+
+#include "ble-json-writer.h"
+
+class BleJournal;
+class BleRecorder;
+class BleReplay;
+class BleSubscription;
+class BleTimerWheel;
+class BleTrace;
+
+/**
+ * @brief The BlePeripheral class
+ *
+ * Connection to one peripheral: the low energy controller, a cache of
+ * service objects discovered on demand, a queue running one GATT
+ * operation at a time and the notification subscriptions.
+ */
+class BlePeripheral: public QObject {
+    Q_OBJECT
+
+public:
+    typedef std::function<void(const QByteArray& value)> SuccessCallback;
+    typedef std::function<void(const QString& error)> ErrorCallback;
+    typedef std::function<void(QLowEnergyService *service)> ServiceCallback;
+    typedef std::function<void()> LinkCallback;
+
+    // service and characteristic UUIDs
+    typedef QPair<QBluetoothUuid, QBluetoothUuid> CharacteristicKey;
+
+    enum OperationType {
+        ReadCharacteristic,
+        WriteCharacteristic,
+        WriteCharacteristicWithoutResponse,
+        ReadDescriptor,
+        WriteDescriptor
+    };
+
+    struct Operation {
+        Operation()
+          : type(ReadCharacteristic), timeout(-1), split(false),
+            transaction(0) {}
+
+        OperationType type;
+        QBluetoothUuid service;
+        QBluetoothUuid characteristic;
+        // descriptor operations only
+        QBluetoothUuid descriptor;
+        QByteArray value;
+        // ms from the start of the operation, -1 for the default of the
+        // type, 0 for none
+        int timeout;
+        // writes without response only, a value longer than the MTU
+        // allows goes out as consecutive writes instead of failing
+        bool split;
+        // operations of a transaction, queued together, are aborted when
+        // one of them fails; 0 for none
+        quint64 transaction;
+        SuccessCallback success;
+        ErrorCallback failure;
+    };
+
+    typedef std::function<void(const Operation& operation)> Submitter;
+
+    // state of the link as last reported by the stack
+    struct Link {
+        Link()
+          : mtu(23), mtuKnown(false), interval(0), latency(0),
+            supervisionTimeout(0), updates(0), packets(0) {}
+
+        // ATT_MTU, the default until the stack reports the exchanged one
+        int mtu;
+        // the stack reported the MTU, needs Qt 5.14
+        bool mtuKnown;
+        // connection interval in ms, 0 until the stack reports it
+        double interval;
+        // connection events the peripheral may skip
+        int latency;
+        // ms, 0 until the stack reports it
+        int supervisionTimeout;
+        // connection parameter and MTU changes
+        quint64 updates;
+        // writes without response sent, after splitting at the MTU
+        quint64 packets;
+    };
+
+    BlePeripheral(const QBluetoothAddress& address, QObject *parent);
+    ~BlePeripheral();
+
+    QLowEnergyController *controller() const { return _controller; }
+
+    QBluetoothAddress remoteAddress() const {
+        return _controller->remoteAddress();
+    }
+    quint64 address() const { return _address; }
+
+    // handle in the table of connected peripherals, 0 if not connected
+    int handle() const { return _handle; }
+    void setHandle(int handle) { _handle = handle; }
+
+    void enqueue(const Operation& operation);
+    // The descriptor writes of subscribe() and unsubscribe() go through
+    // submit, straight to the queue if not set.
+    void setSubmitter(const Submitter& submit) { _submit = submit; }
+    // Operations wait in the queue while the peripheral is not ready,
+    // until its controller is connected.
+    void setReady(bool ready);
+    bool isReady() const { return _ready; }
+    // No operation running or queued and no subscription.
+    bool isIdle() const {
+        return !_busy && _queue.isEmpty() && _subscriptions.isEmpty();
+    }
+    // Fails the current and the queued operations with error.
+    void cancelAll(const QString& error);
+
+    const Link& link() const { return _link; }
+    // value bytes one write without response carries, if the MTU is known
+    int maxWritePayload() const { return _link.mtu - 3; }
+    // Called when the connection parameters or the MTU change.
+    void setLinkCallback(const LinkCallback& changed) { _linkChanged = changed; }
+
+    // Operation deadlines are driven by timers.
+    void setTimerWheel(BleTimerWheel *timers) { _timers = timers; }
+    // Default timeout of the operations of a type in ms, 0 for none.
+    void setTimeout(OperationType type, int timeout);
+
+    void withService(const QBluetoothUuid& uuid,
+                     const ServiceCallback& ready,
+                     const ErrorCallback& failure);
+
+    // Cached service object, not necessarily discovered yet.
+    QLowEnergyService *cachedService(const QBluetoothUuid& uuid) const {
+        return _services.value(uuid).service;
+    }
+
+    // Takes ownership of subscription, replacing any previous one.
+    void subscribe(const QBluetoothUuid& service,
+                   const QBluetoothUuid& characteristic,
+                   BleSubscription *subscription,
+                   const SuccessCallback& success,
+                   const ErrorCallback& failure);
+    // Returns false if the characteristic has no subscription.
+    bool unsubscribe(const QBluetoothUuid& service,
+                     const QBluetoothUuid& characteristic,
+                     const SuccessCallback& success,
+                     const ErrorCallback& failure);
+
+    const QHash<CharacteristicKey, BleSubscription *>& subscriptions() const {
+        return _subscriptions;
+    }
+
+    // Buffer for the callback messages carrying values of the peripheral,
+    // notifications and read results. A message must be sent before the
+    // next one is written.
+    BleJsonWriter& messageWriter() { return _messages; }
+    const BleJsonWriter& messageWriter() const { return _messages; }
+
+    // Notifications are recorded while recorder is recording.
+    void setRecorder(BleRecorder *recorder) { _recorder = recorder; }
+    // Records controller, service and operation events.
+    void setJournal(BleJournal *journal);
+    // Operations and notifications are traced while trace is tracing.
+    void setTrace(BleTrace *trace) { _trace = trace; }
+
+    // Simulated peripheral answering from a replayed trace instead of the
+    // controller.
+    void setReplay(BleReplay *replay);
+    bool isSimulated() const { return _replay != Q_NULLPTR; }
+
+private:
+    struct ServiceWaiter {
+        ServiceCallback ready;
+        ErrorCallback failure;
+    };
+
+    struct ServiceEntry {
+        ServiceEntry() : service(Q_NULLPTR) {}
+
+        QLowEnergyService *service;
+        QList<ServiceWaiter> waiting;
+    };
+
+    void next();
+    void execute(QLowEnergyService *service);
+    void simulate();
+    void notified(const QBluetoothUuid& service,
+                  const QBluetoothUuid& characteristic,
+                  const QByteArray& value);
+    void traceOperation(bool ok, const QByteArray& value,
+                        const QString& error);
+    void journal(int type, const QBluetoothUuid& attribute,
+                 int operation, qint64 value);
+    void complete(const QByteArray& value);
+    void fail(const QString& error);
+    void finish();
+    void failAll(const QString& error);
+    QList<Operation> takeTransaction(quint64 transaction);
+    void linkUpdated();
+
+    bool isCurrent(QLowEnergyService *service,
+                   const QBluetoothUuid& characteristic) const;
+    bool isCurrentDescriptor(QLowEnergyService *service,
+                             const QBluetoothUuid& descriptor) const;
+    bool takeStaleAnswer(QLowEnergyService *service, OperationType type,
+                         const QBluetoothUuid& attribute);
+
+    void serviceStateChanged(const QBluetoothUuid& uuid,
+                             QLowEnergyService::ServiceState state);
+    void serviceError(QLowEnergyService *service,
+                      QLowEnergyService::ServiceError error);
+
+    // request of an operation that timed out, still to be answered by
+    // the stack
+    struct StaleAnswer {
+        QLowEnergyService *service;
+        OperationType type;
+        // characteristic, or descriptor for descriptor operations
+        QBluetoothUuid attribute;
+    };
+
+    QLowEnergyController *_controller;
+    const quint64 _address;
+    int _handle;
+
+    QHash<QBluetoothUuid, ServiceEntry> _services;
+    QHash<CharacteristicKey, BleSubscription *> _subscriptions;
+    BleJsonWriter _messages;
+    BleRecorder *_recorder;
+    BleJournal *_journal;
+    BleTrace *_trace;
+    BleReplay *_replay;
+    BleTimerWheel *_timers;
+    int _timeouts[WriteDescriptor + 1];
+    Link _link;
+    LinkCallback _linkChanged;
+    Submitter _submit;
+
+    QQueue<Operation> _queue;
+    Operation _current;
+    QLowEnergyService *_currentService;
+    // trace time the current operation started at
+    qint64 _currentStarted;
+    // identifies the current operation for delayed answers and timeouts
+    quint64 _sequence;
+    quint64 _timeoutHandle;
+    // answers not to take for the current operation, oldest first
+    QList<StaleAnswer> _staleAnswers;
+    // last transaction that failed, its operations still being queued
+    // are aborted
+    quint64 _abortedTransaction;
+    bool _busy;
+    bool _dispatching;
+    bool _ready;
+};
+
+#endif // BLE_PERIPHERAL_H
@@ -0,0 +1,270 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+
+#include "ble-presence.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <QtNumeric>
+
+#include "ble-json-writer.h"
+
+namespace {
+
+const double kNaN = std::numeric_limits<double>::quiet_NaN();
+
+const char *const kEventNames[] = {
+  "enter",
+  "exit",
+  "zone"
+};
+
+}
+
+BlePresence::BlePresence(BleTimerWheel *timers)
+  : _timers(timers),
+    _enabled(false),
+    _absenceTimeout(10000),
+    _smoothing(0.3),
+    _hysteresis(3),
+    _advertisements(0),
+    _enters(0),
+    _exits(0),
+    _zoneChanges(0) {
+  _clock.start();
+}
+
+BlePresence::~BlePresence() {
+  clear();
+}
+
+/**
+ * @brief BlePresence::configure
+ *
+ * Options: absenceTimeout in ms (10000), smoothing, the weight of a new
+ * RSSI sample between 0 and 1 (0.3), hysteresis in dB (3) and zones, a
+ * list of {name, rssi} where rssi is the weakest smoothed RSSI of the
+ * zone. A device is in the nearest zone it is strong enough for.
+ *
+ * @param options
+ * @param error set when returning false
+ * @return false if the options are invalid, tracking is then disabled
+ */
+bool BlePresence::configure(const QVariantMap& options, QString *error) {
+  clear();
+  _enabled = false;
+  _zones.clear();
+  if (options.isEmpty()) {
+    return true;
+  }
+
+  bool ok = true;
+  _absenceTimeout = options.value("absenceTimeout", 10000).toInt(&ok);
+  if (!ok || _absenceTimeout <= 0) {
+    // TODO i8n
+    *error = QLatin1String("Invalid absenceTimeout");
+    return false;
+  }
+  _smoothing = options.value("smoothing", 0.3).toDouble(&ok);
+  if (!ok || _smoothing <= 0 || _smoothing > 1) {
+    // TODO i8n
+    *error = QLatin1String("Invalid smoothing");
+    return false;
+  }
+  _hysteresis = options.value("hysteresis", 3).toDouble(&ok);
+  if (!ok || _hysteresis < 0) {
+    // TODO i8n
+    *error = QLatin1String("Invalid hysteresis");
+    return false;
+  }
+
+  Q_FOREACH(const QVariant& entry, options.value("zones").toList()) {
+    const QVariantMap zone = entry.toMap();
+    Zone z;
+    z.name = zone.value("name").toString();
+    z.rssi = zone.value("rssi").toDouble(&ok);
+    if (!ok || z.name.isEmpty()) {
+      // TODO i8n
+      *error = QLatin1String("Invalid presence zone");
+      _zones.clear();
+      return false;
+    }
+    _zones.append(z);
+  }
+  std::sort(_zones.begin(), _zones.end(),
+            [](const Zone& a, const Zone& b) { return a.rssi > b.rssi; });
+
+  _enabled = true;
+  return true;
+}
+
+/**
+ * @brief BlePresence::update
+ *
+ * Records an advertisement, reporting the device entering or changing
+ * zone.
+ *
+ * @param address
+ * @param rssi 0 when the stack did not report it
+ */
+void BlePresence::update(quint64 address, int rssi) {
+  ++_advertisements;
+  const double sample = rssi != 0 ? double(rssi) : kNaN;
+
+  auto it = _devices.find(address);
+  if (it == _devices.end()) {
+    Device device;
+    device.rssi = sample;
+    device.zone = zoneFor(sample, NoZone, 0);
+    device.lastSeen = _clock.elapsed();
+    _devices.insert(address, device);
+    schedule(address, _absenceTimeout);
+
+    ++_enters;
+    emitEvent(Enter, address, device, NoZone);
+    return;
+  }
+
+  Device& device = *it;
+  device.lastSeen = _clock.elapsed();
+  if (qIsNaN(sample)) {
+    return;
+  }
+  device.rssi = qIsNaN(device.rssi)
+    ? sample
+    : device.rssi + _smoothing * (sample - device.rssi);
+
+  const int zone = zoneFor(device.rssi, device.zone, _hysteresis);
+  if (zone != device.zone) {
+    const int previous = device.zone;
+    device.zone = zone;
+    ++_zoneChanges;
+    emitEvent(ZoneChange, address, device, previous);
+  }
+}
+
+void BlePresence::clear() {
+  for (auto it = _deadlines.constBegin(); it != _deadlines.constEnd(); ++it) {
+    _timers->cancel(it.value());
+  }
+  _deadlines.clear();
+  _devices.clear();
+}
+
+QString BlePresence::zoneName(int zone) const {
+  return zone == NoZone ? QString() : _zones.at(zone).name;
+}
+
+const char *BlePresence::eventName(EventType type) {
+  return kEventNames[type];
+}
+
+void BlePresence::schedule(quint64 address, int timeout) {
+  _deadlines.insert(address, _timers->schedule(timeout, [this, address]() {
+      expire(address);
+    }));
+}
+
+/**
+ * @brief BlePresence::expire
+ *
+ * Deadline of a device: it exits if it was not seen since the absence
+ * timeout, otherwise the deadline moves to the absence timeout after the
+ * last advertisement.
+ *
+ * @param address
+ */
+void BlePresence::expire(quint64 address) {
+  _deadlines.remove(address);
+  auto it = _devices.find(address);
+  if (it == _devices.end()) {
+    return;
+  }
+
+  const qint64 unseen = _clock.elapsed() - it->lastSeen;
+  if (unseen < _absenceTimeout) {
+    schedule(address, int(_absenceTimeout - unseen));
+    return;
+  }
+
+  const Device device = *it;
+  _devices.erase(it);
+  ++_exits;
+  emitEvent(Exit, address, device, device.zone);
+}
+
+/**
+ * @brief BlePresence::zoneFor
+ *
+ * The nearest zone rssi is strong enough for. Leaving the current zone
+ * takes hysteresis dB beyond its thresholds, so a device on a boundary
+ * does not flap between two zones.
+ *
+ * @param rssi smoothed RSSI, NaN for no zone
+ * @param current zone of the device
+ * @param hysteresis in dB
+ * @return zone index, NoZone if too weak for every zone
+ */
+int BlePresence::zoneFor(double rssi, int current, double hysteresis) const {
+  const int currentIndex = current == NoZone ? _zones.size() : current;
+  for (int i = 0; i < _zones.size(); ++i) {
+    // nearer zones are entered above their threshold plus hysteresis,
+    // the current and farther ones are kept down to minus hysteresis
+    const double threshold = i < currentIndex
+      ? _zones.at(i).rssi + hysteresis
+      : _zones.at(i).rssi - hysteresis;
+    if (rssi >= threshold) {
+      return i;
+    }
+  }
+  return NoZone;
+}
+
+void BlePresence::emitEvent(EventType type, quint64 address,
+                            const Device& device, int previousZone) {
+  if (!_callback) {
+    return;
+  }
+  Event event;
+  event.type = type;
+  event.address = address;
+  event.rssi = device.rssi;
+  event.zone = device.zone;
+  event.previousZone = previousZone;
+  _callback(event);
+}
+
+void BlePresence::write(BleJsonWriter& writer) const {
+  writer.beginObject();
+  writer.key(QLatin1String("tracked"));
+  writer.value(_devices.size());
+  writer.key(QLatin1String("advertisements"));
+  writer.value(qint64(_advertisements));
+  writer.key(QLatin1String("enters"));
+  writer.value(qint64(_enters));
+  writer.key(QLatin1String("exits"));
+  writer.value(qint64(_exits));
+  writer.key(QLatin1String("zoneChanges"));
+  writer.value(qint64(_zoneChanges));
+  writer.endObject();
+}
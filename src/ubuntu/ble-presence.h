@@ -0,0 +1,134 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_PRESENCE_H
+#define BLE_PRESENCE_H
+
+#include <functional>
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+#include "ble-timer-wheel.h"
+
+class BleJsonWriter;
+
+/**
+ * @brief The BlePresence class
+ *
+ * Presence of the devices seen by a scan, configured by the "presence"
+ * scan option. Advertisements update a smoothed RSSI per device; only the
+ * transitions are reported: a device enters when first seen, changes
+ * zone when its smoothed RSSI crosses a zone threshold by more than the
+ * hysteresis, and exits when it was not seen for the absence timeout.
+ *
+ * A device has one pending deadline on the timer wheel. Advertisements
+ * only record the time they were seen; the deadline is pushed back when
+ * it fires, so there is no timer work per advertisement.
+ */
+class BlePresence {
+public:
+    enum EventType {
+        Enter,
+        Exit,
+        ZoneChange
+    };
+
+    // zone of a device weaker than every threshold
+    static const int NoZone = -1;
+
+    struct Event {
+        EventType type;
+        quint64 address;
+        // smoothed, NaN while unknown
+        double rssi;
+        int zone;
+        int previousZone;
+    };
+
+    typedef std::function<void(const Event& event)> Callback;
+
+    explicit BlePresence(BleTimerWheel *timers);
+    ~BlePresence();
+
+    // options of the "presence" scan option, empty to disable tracking
+    bool configure(const QVariantMap& options, QString *error);
+    bool isEnabled() const { return _enabled; }
+
+    void setCallback(const Callback& callback) { _callback = callback; }
+
+    // An advertisement of address, rssi 0 when not reported.
+    void update(quint64 address, int rssi);
+    // Forgets the devices, without exit events.
+    void clear();
+
+    int tracked() const { return _devices.size(); }
+    // zone name, a null string for NoZone
+    QString zoneName(int zone) const;
+    static const char *eventName(EventType type);
+
+    void write(BleJsonWriter& writer) const;
+
+private:
+    struct Zone {
+        QString name;
+        // weakest smoothed RSSI in the zone, in dBm
+        double rssi;
+    };
+
+    struct Device {
+        double rssi;
+        int zone;
+        // _clock ms
+        qint64 lastSeen;
+    };
+
+    void schedule(quint64 address, int timeout);
+    void expire(quint64 address);
+    int zoneFor(double rssi, int current, double hysteresis) const;
+    void emitEvent(EventType type, quint64 address, const Device& device,
+                   int previousZone);
+
+    BleTimerWheel *_timers;
+    QElapsedTimer _clock;
+    bool _enabled;
+
+    int _absenceTimeout;
+    // weight of a new sample in the moving average
+    double _smoothing;
+    double _hysteresis;
+    // nearest first
+    QVector<Zone> _zones;
+
+    QHash<quint64, Device> _devices;
+    QHash<quint64, BleTimerWheel::Handle> _deadlines;
+    Callback _callback;
+
+    quint64 _advertisements;
+    quint64 _enters;
+    quint64 _exits;
+    quint64 _zoneChanges;
+};
+
+#endif // BLE_PRESENCE_H
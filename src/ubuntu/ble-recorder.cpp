@@ -0,0 +1,235 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-recorder.h"
+
+#include <cstring>
+
+#include <QDateTime>
+#include <QtEndian>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+const char kMagic[8] = { 'B', 'L', 'E', 'C', 'A', 'P', '0', '1' };
+const quint32 kVersion = 1;
+
+// offset of the u64 records size in the header
+const int kSizeOffset = 24;
+
+void uuidToBigEndian(const QBluetoothUuid& uuid, uchar *out) {
+  const quint128 value = uuid.toUInt128();
+  std::memcpy(out, value.data, 16);
+}
+
+}
+
+uint qHash(const BleRecorder::StreamKey& key, uint seed) {
+  return qHash(key.address, seed)
+    ^ qHash(key.service, seed)
+    ^ qHash(key.characteristic, seed);
+}
+
+BleRecorder::BleRecorder()
+  : _map(Q_NULLPTR),
+    _capacity(0),
+    _size(0),
+    _syncedSize(0),
+    _samples(0),
+    _dropped(0) {
+  QObject::connect(&_syncTimer, &QTimer::timeout, [this]() {
+      sync(false);
+    });
+}
+
+BleRecorder::~BleRecorder() {
+  stop();
+}
+
+/**
+ * @brief BleRecorder::start
+ *
+ * Creates and maps the capture file. A recording in progress is stopped.
+ *
+ * @param path capture file, overwritten
+ * @param capacity file size in bytes
+ * @param syncInterval time between syncs in ms, 0 syncs only on stop
+ * @param error set if the file can not be created
+ * @return true if recording
+ */
+bool BleRecorder::start(const QString& path,
+                        qint64 capacity,
+                        int syncInterval,
+                        QString *error) {
+  stop();
+
+  _file.setFileName(path);
+  // allocates the blocks up front, writing to a mapped hole of a full
+  // disk would raise SIGBUS
+  if (capacity < HeaderSize
+      || !_file.open(QIODevice::ReadWrite | QIODevice::Truncate)
+      || ::posix_fallocate(_file.handle(), 0, capacity) != 0) {
+    // TODO i8n
+    *error = QString("Could not create capture file %1").arg(path);
+    _file.close();
+    return false;
+  }
+
+  _map = _file.map(0, capacity);
+  if (!_map) {
+    // TODO i8n
+    *error = QString("Could not map capture file %1").arg(path);
+    _file.close();
+    return false;
+  }
+
+  _capacity = capacity;
+  _size = 0;
+  _syncedSize = 0;
+  _samples = 0;
+  _dropped = 0;
+  _streams.clear();
+
+  std::memcpy(_map, kMagic, sizeof(kMagic));
+  qToLittleEndian<quint32>(kVersion, _map + 8);
+  qToLittleEndian<quint32>(HeaderSize, _map + 12);
+  qToLittleEndian<quint64>(QDateTime::currentMSecsSinceEpoch(), _map + 16);
+  qToLittleEndian<quint64>(0, _map + kSizeOffset);
+
+  _clock.start();
+  if (syncInterval > 0) {
+    _syncTimer.start(syncInterval);
+  }
+  return true;
+}
+
+/**
+ * @brief BleRecorder::stop
+ *
+ * Syncs, unmaps and truncates the capture file to the recorded size.
+ */
+void BleRecorder::stop() {
+  if (!_map) {
+    return;
+  }
+  _syncTimer.stop();
+  sync(true);
+
+  _file.unmap(_map);
+  _map = Q_NULLPTR;
+  _file.resize(HeaderSize + _size);
+  _file.close();
+}
+
+/**
+ * @brief BleRecorder::record
+ *
+ * Appends a sample, counted as dropped if the file is full.
+ *
+ * @param address device address
+ * @param service service UUID
+ * @param characteristic characteristic UUID
+ * @param value characteristic value
+ */
+void BleRecorder::record(quint64 address,
+                         const QBluetoothUuid& service,
+                         const QBluetoothUuid& characteristic,
+                         const QByteArray& value) {
+  if (!_map) {
+    return;
+  }
+
+  const StreamKey key = { address, service, characteristic };
+  auto it = _streams.find(key);
+  if (it == _streams.end()) {
+    if (_streams.size() > 0xffff) {
+      ++_dropped;
+      return;
+    }
+    const quint16 stream = quint16(_streams.size());
+
+    uchar payload[40];
+    qToLittleEndian<quint64>(address, payload);
+    uuidToBigEndian(service, payload + 8);
+    uuidToBigEndian(characteristic, payload + 24);
+    if (!append(StreamRecord, stream,
+                reinterpret_cast<const char *>(payload), sizeof(payload))) {
+      ++_dropped;
+      return;
+    }
+    it = _streams.insert(key, stream);
+  }
+
+  if (append(SampleRecord, *it, value.constData(), value.size())) {
+    ++_samples;
+  } else {
+    ++_dropped;
+  }
+}
+
+bool BleRecorder::append(RecordType type, quint16 stream,
+                         const char *payload, int size) {
+  if (HeaderSize + _size + RecordHeaderSize + size > _capacity) {
+    return false;
+  }
+
+  uchar *record = _map + HeaderSize + _size;
+  record[0] = uchar(type);
+  record[1] = 0;
+  qToLittleEndian<quint16>(stream, record + 2);
+  qToLittleEndian<quint32>(quint32(size), record + 4);
+  qToLittleEndian<quint64>(quint64(_clock.nsecsElapsed() / 1000),
+                           record + 8);
+  std::memcpy(record + RecordHeaderSize, payload, size);
+
+  _size += RecordHeaderSize + size;
+  return true;
+}
+
+/**
+ * @brief BleRecorder::sync
+ *
+ * Publishes the records size in the header and flushes the pages written
+ * since the last sync.
+ *
+ * @param wait true to wait for the pages to be written
+ */
+void BleRecorder::sync(bool wait) {
+  if (_size == _syncedSize && !wait) {
+    return;
+  }
+  qToLittleEndian<quint64>(quint64(_size), _map + kSizeOffset);
+
+  const qint64 pageSize = ::sysconf(_SC_PAGESIZE);
+  const qint64 begin = (HeaderSize + _syncedSize) / pageSize * pageSize;
+  const qint64 end = HeaderSize + _size;
+  const int flags = wait ? MS_SYNC : MS_ASYNC;
+
+  // the header page holds the records size
+  ::msync(_map, qMin(pageSize, _capacity), flags);
+  if (end > begin) {
+    ::msync(_map + begin, end - begin, flags);
+  }
+  _syncedSize = _size;
+}
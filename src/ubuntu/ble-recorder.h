@@ -0,0 +1,129 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_RECORDER_H
+#define BLE_RECORDER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QTimer>
+
+#include <QBluetoothUuid>
+
+/**
+ * @brief The BleRecorder class
+ *
+ * Records notifications into a preallocated, memory-mapped capture file.
+ * Recording a sample is a copy into the mapping; the file is synced
+ * periodically and truncated to the recorded size when stopped.
+ *
+ * File format, all integers little endian:
+ *
+ *   header, HeaderSize bytes:
+ *     char[8] "BLECAP01"
+ *     u32 version, u32 header size
+ *     u64 start time, ms since the epoch
+ *     u64 size of the records, updated on every sync
+ *
+ *   records, RecordHeaderSize bytes followed by the payload:
+ *     u8 type, u8 reserved, u16 stream, u32 payload size,
+ *     u64 time, us since the start time
+ *
+ *   StreamRecord payload, written before the first sample of a stream:
+ *     u64 device address, u8[16] service UUID, u8[16] characteristic UUID
+ *     (UUIDs big endian)
+ *
+ *   SampleRecord payload: the characteristic value
+ */
+class BleRecorder {
+public:
+    enum RecordType {
+        StreamRecord = 1,
+        SampleRecord = 2
+    };
+
+    static const int HeaderSize = 32;
+    static const int RecordHeaderSize = 16;
+
+    BleRecorder();
+    ~BleRecorder();
+
+    /**
+     * Creates the capture file, capacity bytes large.
+     * syncInterval is the time between syncs in ms.
+     */
+    bool start(const QString& path,
+               qint64 capacity,
+               int syncInterval,
+               QString *error);
+    void stop();
+
+    bool isRecording() const { return _map != Q_NULLPTR; }
+
+    void record(quint64 address,
+                const QBluetoothUuid& service,
+                const QBluetoothUuid& characteristic,
+                const QByteArray& value);
+
+    QString path() const { return _file.fileName(); }
+    qint64 capacity() const { return _capacity; }
+    qint64 bytesWritten() const { return _size; }
+    quint64 samples() const { return _samples; }
+    // samples not recorded because the file was full
+    quint64 dropped() const { return _dropped; }
+
+private:
+    struct StreamKey {
+        quint64 address;
+        QBluetoothUuid service;
+        QBluetoothUuid characteristic;
+
+        bool operator==(const StreamKey& other) const {
+            return address == other.address
+                && service == other.service
+                && characteristic == other.characteristic;
+        }
+    };
+    friend uint qHash(const StreamKey& key, uint seed);
+
+    bool append(RecordType type, quint16 stream,
+                const char *payload, int size);
+    void sync(bool wait);
+
+    QFile _file;
+    uchar *_map;
+    qint64 _capacity;
+    qint64 _size;
+    qint64 _syncedSize;
+
+    QElapsedTimer _clock;
+    QTimer _syncTimer;
+
+    QHash<StreamKey, quint16> _streams;
+
+    quint64 _samples;
+    quint64 _dropped;
+};
+
+#endif // BLE_RECORDER_H
@@ -0,0 +1,377 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-replay.h"
+
+#include <cmath>
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtEndian>
+
+#include <QBluetoothAddress>
+
+#include "ble-peripheral.h"
+
+namespace {
+
+// events emitted per turn of the event loop when running without delays
+const int kBatchSize = 256;
+
+// locally administered addresses of the generated peripherals
+const quint64 kSyntheticAddress = Q_UINT64_C(0x020000000000);
+const quint16 kSyntheticService = 0xffe0;
+const quint16 kSyntheticCharacteristic = 0xffe1;
+// manufacturer data of the generated scan results, the test company id
+const quint16 kSyntheticCompany = 0xffff;
+
+// connected peripheral description, as reported to JavaScript
+QString syntheticPeripheral(const QBluetoothAddress& address,
+                            const QString& name) {
+  QJsonArray properties;
+  properties.append(QLatin1String("Read"));
+  properties.append(QLatin1String("WriteWithoutResponse"));
+  properties.append(QLatin1String("Write"));
+  properties.append(QLatin1String("Notify"));
+
+  QJsonObject cccd;
+  cccd.insert("uuid", QLatin1String("2902"));
+  QJsonArray descriptors;
+  descriptors.append(cccd);
+
+  QJsonObject characteristic;
+  characteristic.insert("service", QLatin1String("ffe0"));
+  characteristic.insert("characteristic", QLatin1String("ffe1"));
+  characteristic.insert("properties", properties);
+  characteristic.insert("descriptors", descriptors);
+  QJsonArray characteristics;
+  characteristics.append(characteristic);
+
+  QJsonArray services;
+  services.append(QLatin1String("ffe0"));
+
+  QJsonObject peripheral;
+  peripheral.insert("name", name);
+  peripheral.insert("id", address.toString());
+  peripheral.insert("services", services);
+  peripheral.insert("characteristics", characteristics);
+  return QString::fromUtf8(QJsonDocument(peripheral).toJson());
+}
+
+}
+
+uint qHash(const BleReplay::OperationKey& key, uint seed) {
+  return qHash(key.address, seed)
+    ^ qHash(key.type, seed)
+    ^ qHash(key.characteristic, seed)
+    ^ qHash(key.descriptor, seed);
+}
+
+BleReplay::BleReplay(QObject *parent)
+  : QObject(parent),
+    _next(0),
+    _speed(1.0),
+    _running(false) {
+  _timer.setSingleShot(true);
+  QObject::connect(&_timer, &QTimer::timeout, this, &BleReplay::advance);
+}
+
+/**
+ * @brief BleReplay::load
+ *
+ * Reads a trace and indexes its connections and operations.
+ *
+ * @param path trace file
+ * @param error set if the trace can not be read
+ * @return true if loaded
+ */
+bool BleReplay::load(const QString& path, QString *error) {
+  stop();
+
+  if (!BleTrace::load(path, &_events, error)) {
+    return false;
+  }
+  index();
+  return true;
+}
+
+/**
+ * @brief BleReplay::generate
+ *
+ * Builds the events of synthetic peripherals: their scan results, one
+ * connection each, answers to every operation on their characteristic
+ * and notifications, then indexes them as a loaded trace.
+ *
+ * @param options see the header
+ * @param error set if an option is out of range
+ * @return true if generated
+ */
+bool BleReplay::generate(const QVariantMap& options, QString *error) {
+  stop();
+
+  const int devices = options.value("devices", 1).toInt();
+  const int advertisements = options.value("advertisements", 1).toInt();
+  const qint64 advertisingInterval =
+    options.value("advertisingInterval", 100).toLongLong() * 1000;
+  const int notifications = options.value("notifications", 0).toInt();
+  const qint64 notificationInterval =
+    options.value("notificationInterval", 10).toLongLong() * 1000;
+  const qint64 duration = options.value("duration", 0).toLongLong() * 1000;
+  const qint64 connectDuration =
+    options.value("connectDuration", 0).toLongLong() * 1000;
+
+  QList<QByteArray> values;
+  Q_FOREACH(const QVariant& value,
+            options.value("values", QVariantList() << "0000").toList()) {
+    values.append(QByteArray::fromHex(value.toString().toLatin1()));
+  }
+
+  if (devices < 1 || advertisements < 0 || notifications < 0
+      || advertisingInterval < 0 || notificationInterval < 0
+      || duration < 0 || connectDuration < 0 || values.isEmpty()) {
+    // TODO i8n
+    *error = QLatin1String("Invalid synthetic traffic options");
+    return false;
+  }
+
+  const QBluetoothUuid service(kSyntheticService);
+  const QBluetoothUuid characteristic(kSyntheticCharacteristic);
+  const QBluetoothUuid cccd(
+    QBluetoothUuid::ClientCharacteristicConfiguration);
+
+  _events.clear();
+  for (int i = 0; i < devices; ++i) {
+    const quint64 address = kSyntheticAddress + quint64(i) + 1;
+    const QString name = QString("Synthetic %1").arg(i + 1);
+
+    BleTrace::Event connected;
+    connected.type = BleTrace::ConnectedEvent;
+    connected.address = address;
+    connected.text = syntheticPeripheral(QBluetoothAddress(address), name);
+    connected.duration = connectDuration;
+    _events.append(connected);
+
+    const int types[] = {
+      BlePeripheral::ReadCharacteristic,
+      BlePeripheral::WriteCharacteristic,
+      BlePeripheral::WriteCharacteristicWithoutResponse,
+      BlePeripheral::ReadDescriptor,
+      BlePeripheral::WriteDescriptor
+    };
+    for (int type : types) {
+      BleTrace::Event operation;
+      operation.type = BleTrace::OperationEvent;
+      operation.address = address;
+      operation.operation = type;
+      operation.service = service;
+      operation.characteristic = characteristic;
+      if (type == BlePeripheral::ReadDescriptor
+          || type == BlePeripheral::WriteDescriptor) {
+        operation.descriptor = cccd;
+        operation.value = QByteArray(2, 0);
+      } else {
+        operation.value = values.first();
+      }
+      operation.duration = duration;
+      _events.append(operation);
+    }
+  }
+
+  // scan results round robin over the peripherals, then notifications
+  qint64 time = 0;
+  for (int k = 0; k < devices * advertisements; ++k) {
+    const int i = k % devices;
+    BleTrace::Event scanResult;
+    scanResult.type = BleTrace::ScanResultEvent;
+    scanResult.time = time;
+    scanResult.address = kSyntheticAddress + quint64(i) + 1;
+    scanResult.name = QString("Synthetic %1").arg(i + 1);
+    scanResult.rssi = qint16(-40 - k % 50);
+    scanResult.serviceUuids.append(service);
+    QByteArray counter(4, 0);
+    qToLittleEndian<quint32>(quint32(k),
+                             reinterpret_cast<uchar *>(counter.data()));
+    scanResult.manufacturerData.insert(kSyntheticCompany, counter);
+    _events.append(scanResult);
+    time += advertisingInterval;
+  }
+  for (int k = 0; k < devices * notifications; ++k) {
+    BleTrace::Event notification;
+    notification.type = BleTrace::NotificationEvent;
+    notification.time = time;
+    notification.address = kSyntheticAddress + quint64(k % devices) + 1;
+    notification.service = service;
+    notification.characteristic = characteristic;
+    notification.value = values.at((k / devices) % values.size());
+    _events.append(notification);
+    time += notificationInterval;
+  }
+
+  index();
+  return true;
+}
+
+void BleReplay::index() {
+  _connections.clear();
+  _responses.clear();
+  _timeline.clear();
+
+  for (int i = 0; i < _events.size(); ++i) {
+    const BleTrace::Event& event = _events.at(i);
+    switch (event.type) {
+    case BleTrace::ConnectedEvent:
+    case BleTrace::ConnectFailedEvent:
+      _connections[event.address].events.append(i);
+      break;
+    case BleTrace::OperationEvent: {
+      const OperationKey key = {
+        event.address, event.operation,
+        event.service, event.characteristic, event.descriptor
+      };
+      _responses[key].events.append(i);
+      break;
+    }
+    case BleTrace::ScanResultEvent:
+    case BleTrace::NotificationEvent:
+      _timeline.append(i);
+      break;
+    case BleTrace::DisconnectedEvent:
+      break;
+    }
+  }
+}
+
+void BleReplay::start(double speed) {
+  _speed = qMax(0.0, speed);
+  _next = 0;
+  _running = true;
+  _clock.start();
+  advance();
+}
+
+void BleReplay::stop() {
+  _running = false;
+  _timer.stop();
+}
+
+const BleTrace::Event *BleReplay::connection(quint64 address) {
+  auto it = _connections.find(address);
+  return it == _connections.end() ? Q_NULLPTR : take(&*it);
+}
+
+const BleTrace::Event *BleReplay::response(
+    quint64 address,
+    int type,
+    const QBluetoothUuid& service,
+    const QBluetoothUuid& characteristic,
+    const QBluetoothUuid& descriptor) {
+  const OperationKey key = {
+    address, type, service, characteristic, descriptor
+  };
+  auto it = _responses.find(key);
+  return it == _responses.end() ? Q_NULLPTR : take(&*it);
+}
+
+const BleTrace::Event *BleReplay::take(Cursor *cursor) const {
+  const BleTrace::Event *event = &_events.at(cursor->events.at(cursor->next));
+  cursor->next = (cursor->next + 1) % cursor->events.size();
+  return event;
+}
+
+int BleReplay::delay(qint64 duration) const {
+  if (_speed <= 0) {
+    return 0;
+  }
+  return int(std::ceil(duration / 1000.0 / _speed));
+}
+
+/**
+ * @brief BleReplay::advance
+ *
+ * Emits the timeline events the replay clock has reached, then waits for
+ * the next one.
+ */
+void BleReplay::advance() {
+  if (!_running) {
+    return;
+  }
+  if (_timeline.isEmpty()) {
+    _running = false;
+    emit finished();
+    return;
+  }
+
+  const qint64 origin = _events.at(_timeline.first()).time;
+  int emitted = 0;
+  while (_running && _next < _timeline.size()) {
+    const BleTrace::Event& event = _events.at(_timeline.at(_next));
+    const qint64 due = event.time - origin;
+
+    if (_speed > 0) {
+      const qint64 reached =
+        qint64(_clock.nsecsElapsed() / 1000 * _speed);
+      if (due > reached) {
+        _timer.start(delay(due - reached));
+        return;
+      }
+    } else if (emitted == kBatchSize) {
+      _timer.start(0);
+      return;
+    }
+
+    ++_next;
+    ++emitted;
+    emitEvent(event);
+  }
+
+  if (_running) {
+    _running = false;
+    emit finished();
+  }
+}
+
+void BleReplay::emitEvent(const BleTrace::Event& event) {
+  if (event.type == BleTrace::NotificationEvent) {
+    emit notification(event.address,
+                      event.service,
+                      event.characteristic,
+                      event.value);
+    return;
+  }
+
+  QBluetoothDeviceInfo deviceInfo(QBluetoothAddress(event.address),
+                                  event.name,
+                                  0);
+  deviceInfo.setCoreConfigurations(
+    QBluetoothDeviceInfo::LowEnergyCoreConfiguration);
+  deviceInfo.setRssi(event.rssi);
+  deviceInfo.setServiceUuids(event.serviceUuids,
+                             QBluetoothDeviceInfo::DataComplete);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+  for (auto it = event.manufacturerData.constBegin();
+       it != event.manufacturerData.constEnd();
+       ++it) {
+    deviceInfo.setManufacturerData(it.key(), it.value());
+  }
+#endif
+  emit deviceDiscovered(deviceInfo);
+}
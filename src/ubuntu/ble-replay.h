@@ -0,0 +1,150 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_REPLAY_H
+#define BLE_REPLAY_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+#include <QVariant>
+#include <QVector>
+
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+
+#include "ble-trace.h"
+
+/**
+ * @brief The BleReplay class
+ *
+ * Simulated backend replaying a BleTrace. Scan results and notifications
+ * are emitted on the timeline of the trace, scaled by the replay speed.
+ * Connections and GATT operations are answered with the outcome and
+ * duration recorded for the same device and attribute, in recorded order,
+ * starting over once all were used.
+ *
+ * Instead of a trace file, the replay can run generated traffic, so that
+ * tests do not depend on a capture of real devices.
+ */
+class BleReplay: public QObject {
+    Q_OBJECT
+
+public:
+    explicit BleReplay(QObject *parent = Q_NULLPTR);
+
+    bool load(const QString& path, QString *error);
+
+    /**
+     * Generates the events of synthetic peripherals instead of loading a
+     * trace. Accepted options, all optional:
+     *   devices: number of peripherals, 1 by default
+     *   advertisements: scan results per peripheral, 1 by default
+     *   advertisingInterval: ms between scan results, 100 by default
+     *   notifications: notifications per peripheral, sent after the scan
+     *                  results, 0 by default
+     *   notificationInterval: ms between notifications, 10 by default
+     *   values: hex payloads of the notifications, used in turn, and of
+     *           reads, the first one; ["0000"] by default
+     *   duration: ms every GATT operation takes, 0 by default
+     *   connectDuration: ms a connection takes, 0 by default
+     * Every peripheral has service ffe0 with characteristic ffe1, which
+     * can be read, written, written without response and notified.
+     */
+    bool generate(const QVariantMap& options, QString *error);
+
+    // speed multiplies the pace of the trace, 0 replays without delays
+    void start(double speed);
+    void stop();
+    bool isRunning() const { return _running; }
+
+    int eventCount() const { return _events.size(); }
+
+    // Recorded connection to address, null if the trace has none.
+    const BleTrace::Event *connection(quint64 address);
+    // Recorded outcome of an operation, null if the trace has none.
+    const BleTrace::Event *response(quint64 address,
+                                    int type,
+                                    const QBluetoothUuid& service,
+                                    const QBluetoothUuid& characteristic,
+                                    const QBluetoothUuid& descriptor);
+
+    // ms to wait for something that took duration us in the trace
+    int delay(qint64 duration) const;
+
+signals:
+    void deviceDiscovered(const QBluetoothDeviceInfo& deviceInfo);
+    void notification(quint64 address,
+                      const QBluetoothUuid& service,
+                      const QBluetoothUuid& characteristic,
+                      const QByteArray& value);
+    // every scan result and notification of the trace was emitted
+    void finished();
+
+private slots:
+    void advance();
+
+private:
+    struct OperationKey {
+        quint64 address;
+        int type;
+        QBluetoothUuid service;
+        QBluetoothUuid characteristic;
+        QBluetoothUuid descriptor;
+
+        bool operator==(const OperationKey& other) const {
+            return address == other.address
+                && type == other.type
+                && service == other.service
+                && characteristic == other.characteristic
+                && descriptor == other.descriptor;
+        }
+    };
+    friend uint qHash(const OperationKey& key, uint seed);
+
+    // recorded events of one key, used round robin
+    struct Cursor {
+        Cursor() : next(0) {}
+
+        QVector<int> events;
+        int next;
+    };
+
+    void index();
+    const BleTrace::Event *take(Cursor *cursor) const;
+    void emitEvent(const BleTrace::Event& event);
+
+    QVector<BleTrace::Event> _events;
+    QHash<quint64, Cursor> _connections;
+    QHash<OperationKey, Cursor> _responses;
+
+    // scan results and notifications, in time order
+    QVector<int> _timeline;
+    int _next;
+
+    QTimer _timer;
+    QElapsedTimer _clock;
+    double _speed;
+    bool _running;
+};
+
+#endif // BLE_REPLAY_H
@@ -0,0 +1,60 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-resource-usage.h"
+
+#include <unistd.h>
+
+#include <QDir>
+#include <QFile>
+#include <QList>
+#include <QObject>
+
+int BleResourceUsage::objectCount(const QObject *root) {
+  return root->findChildren<QObject *>().size();
+}
+
+qint64 BleResourceUsage::residentSetSize() {
+  QFile statm(QLatin1String("/proc/self/statm"));
+  if (!statm.open(QIODevice::ReadOnly)) {
+    return -1;
+  }
+
+  // size resident shared text lib data dt, in pages
+  const QList<QByteArray> fields = statm.readLine().split(' ');
+  bool ok = false;
+  const qint64 pages = fields.value(1).toLongLong(&ok);
+  if (!ok) {
+    return -1;
+  }
+  return pages * sysconf(_SC_PAGESIZE);
+}
+
+int BleResourceUsage::openFileDescriptors() {
+  const QDir fds(QLatin1String("/proc/self/fd"));
+  if (!fds.exists()) {
+    return -1;
+  }
+  // entries are links to files, sockets, pipes and directories; the
+  // descriptor of the listing itself is closed by the time it returns
+  return fds.entryList(QDir::AllEntries | QDir::System
+                       | QDir::NoDotAndDotDot).size();
+}
@@ -0,0 +1,47 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_RESOURCE_USAGE_H
+#define BLE_RESOURCE_USAGE_H
+
+#include <QtGlobal>
+
+class QObject;
+
+/**
+ * @brief The BleResourceUsage class
+ *
+ * Resources of the process and of the plugin object tree, sampled by soak
+ * tests to find what grows over thousands of connection cycles.
+ */
+class BleResourceUsage {
+public:
+    // QObjects below root, root excluded
+    static int objectCount(const QObject *root);
+
+    // resident set size in bytes, -1 where /proc is not available
+    static qint64 residentSetSize();
+
+    // open file descriptors, -1 where /proc is not available
+    static int openFileDescriptors();
+};
+
+#endif // BLE_RESOURCE_USAGE_H
@@ -0,0 +1,295 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-scan-filter.h"
+
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+bool parseHex(const QVariant& value, QByteArray *out) {
+  const QByteArray hex = value.toString().toLatin1();
+  if (hex.size() % 2 != 0) {
+    return false;
+  }
+  for (int i = 0; i < hex.size(); ++i) {
+    if (!isxdigit(static_cast<uchar>(hex.at(i)))) {
+      return false;
+    }
+  }
+  *out = QByteArray::fromHex(hex);
+  return true;
+}
+
+}
+
+BleScanFilter::BleScanFilter()
+  : _globalCount(0) {
+}
+
+void BleScanFilter::clear() {
+  _program.clear();
+  _entryEnds.clear();
+  _bytes.clear();
+  _globalCount = 0;
+}
+
+/**
+ * @brief BleScanFilter::compile
+ *
+ * Each filter entry accepts the following keys, all optional:
+ *   rssi: minimum RSSI in dBm
+ *   namePrefix: prefix of the local name
+ *   manufacturerId: company identifier of the manufacturer specific data
+ *   manufacturerData, manufacturerDataMask: hex encoded prefix of the
+ *     manufacturer specific data following the company identifier
+ *   adType, data, mask: hex encoded prefix of any other AD structure
+ *
+ * @param services service UUIDs, at least one must be advertised
+ * @param filters list of filter entries
+ * @param error receives a description of the first invalid entry
+ * @return true on success
+ */
+bool BleScanFilter::compile(const QList<QBluetoothUuid>& services,
+                            const QVariantList& filters,
+                            QString *error) {
+  clear();
+
+  if (!services.isEmpty()) {
+    Instruction i;
+    i.opcode = AnyService;
+    i.adType = 0;
+    i.rssi = 0;
+    i.offset = _bytes.size();
+
+    uchar buffer[16];
+    Q_FOREACH(const QBluetoothUuid& uuid, services) {
+      const int width = BleAdvertisement::uuidToLittleEndian(uuid, buffer);
+      if (width > 0) {
+        _bytes.append(char(width));
+        _bytes.append(reinterpret_cast<const char *>(buffer), width);
+      }
+    }
+    i.size = _bytes.size() - i.offset;
+    _program.append(i);
+  }
+  _globalCount = _program.size();
+
+  Q_FOREACH(const QVariant& entry, filters) {
+    if (!compileEntry(entry.toMap(), error)) {
+      clear();
+      return false;
+    }
+    _entryEnds.append(_program.size());
+  }
+  return true;
+}
+
+bool BleScanFilter::compileEntry(const QVariantMap& entry, QString *error) {
+  const int first = _program.size();
+
+  if (entry.contains("rssi")) {
+    Instruction i;
+    i.opcode = RssiFloor;
+    i.adType = 0;
+    i.rssi = qint16(entry.value("rssi").toInt());
+    i.offset = 0;
+    i.size = 0;
+    _program.append(i);
+  }
+
+  if (entry.contains("namePrefix")) {
+    appendPrefix(NamePrefix, BleAdvertisement::CompleteLocalName,
+                 entry.value("namePrefix").toString().toUtf8(),
+                 QByteArray());
+  }
+
+  if (entry.contains("manufacturerId")) {
+    bool ok = false;
+    const uint id = entry.value("manufacturerId").toUInt(&ok);
+    QByteArray data;
+    QByteArray mask;
+    if (!ok || id > 0xffff
+        || !parseHex(entry.value("manufacturerData"), &data)
+        || !parseHex(entry.value("manufacturerDataMask"), &mask)) {
+      // TODO i8n
+      *error = QLatin1String("Invalid manufacturer filter");
+      return false;
+    }
+    data.prepend(char(id >> 8));
+    data.prepend(char(id & 0xff));
+    if (!mask.isEmpty()) {
+      mask.prepend("\xff\xff", 2);
+    }
+    appendPrefix(FieldPrefix, BleAdvertisement::ManufacturerSpecificData,
+                 data, mask);
+  }
+
+  if (entry.contains("adType")) {
+    bool ok = false;
+    const uint type = entry.value("adType").toUInt(&ok);
+    QByteArray data;
+    QByteArray mask;
+    if (!ok || type > 0xff
+        || !parseHex(entry.value("data"), &data)
+        || !parseHex(entry.value("mask"), &mask)) {
+      // TODO i8n
+      *error = QLatin1String("Invalid AD structure filter");
+      return false;
+    }
+    appendPrefix(FieldPrefix, quint8(type), data, mask);
+  }
+
+  if (_program.size() == first) {
+    // TODO i8n
+    *error = QLatin1String("Empty scan filter");
+    return false;
+  }
+  return true;
+}
+
+void BleScanFilter::appendPrefix(quint8 opcode, quint8 adType,
+                                 const QByteArray& value,
+                                 const QByteArray& mask) {
+  Instruction i;
+  i.opcode = opcode;
+  i.adType = adType;
+  i.rssi = 0;
+  i.offset = _bytes.size();
+  i.size = value.size();
+
+  // bytes not covered by the mask must match exactly
+  QByteArray m = mask.left(value.size());
+  while (m.size() < value.size()) {
+    m.append(char(0xff));
+  }
+
+  for (int b = 0; b < value.size(); ++b) {
+    _bytes.append(char(value.at(b) & m.at(b)));
+  }
+  _bytes.append(m);
+
+  _program.append(i);
+}
+
+/**
+ * @brief BleScanFilter::matches
+ *
+ * @param advertisement
+ * @return true if the advertisement passes the program, or if the
+ *         program is empty
+ */
+bool BleScanFilter::matches(const BleAdvertisement& advertisement) const {
+  for (int i = 0; i < _globalCount; ++i) {
+    if (!execute(_program.at(i), advertisement)) {
+      return false;
+    }
+  }
+
+  if (_entryEnds.isEmpty()) {
+    return true;
+  }
+
+  int first = _globalCount;
+  Q_FOREACH(int end, _entryEnds) {
+    bool match = true;
+    for (int i = first; match && i < end; ++i) {
+      match = execute(_program.at(i), advertisement);
+    }
+    if (match) {
+      return true;
+    }
+    first = end;
+  }
+  return false;
+}
+
+bool BleScanFilter::execute(const Instruction& instruction,
+                            const BleAdvertisement& advertisement) const {
+  switch (instruction.opcode) {
+  case AnyService:
+    return matchesService(instruction, advertisement);
+
+  case RssiFloor:
+    return advertisement.rssi() >= instruction.rssi;
+
+  case NamePrefix:
+  case FieldPrefix: {
+    quint8 type;
+    BleAdvertisement::Field field;
+    int offset = 0;
+    while ((offset = advertisement.nextField(offset, &type, &field)) >= 0) {
+      const bool candidate = instruction.opcode == NamePrefix
+        ? (type == BleAdvertisement::CompleteLocalName
+           || type == BleAdvertisement::ShortenedLocalName)
+        : type == instruction.adType;
+      if (candidate && matchesPrefix(instruction, field)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  }
+  return false;
+}
+
+bool BleScanFilter::matchesService(const Instruction& instruction,
+                                   const BleAdvertisement& advertisement) const {
+  const uchar *uuids =
+    reinterpret_cast<const uchar *>(_bytes.constData()) + instruction.offset;
+
+  quint8 type;
+  BleAdvertisement::Field field;
+  int offset = 0;
+  while ((offset = advertisement.nextField(offset, &type, &field)) >= 0) {
+    const int width = BleAdvertisement::uuidWidth(type);
+    if (width == 0) {
+      continue;
+    }
+    for (int f = 0; f + width <= field.size; f += width) {
+      for (int u = 0; u < instruction.size; u += 1 + uuids[u]) {
+        if (uuids[u] == width
+            && std::memcmp(uuids + u + 1, field.data + f, width) == 0) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+bool BleScanFilter::matchesPrefix(const Instruction& instruction,
+                                  const BleAdvertisement::Field& field) const {
+  if (field.size < instruction.size) {
+    return false;
+  }
+
+  const uchar *value =
+    reinterpret_cast<const uchar *>(_bytes.constData()) + instruction.offset;
+  const uchar *mask = value + instruction.size;
+  for (int b = 0; b < instruction.size; ++b) {
+    if ((field.data[b] & mask[b]) != value[b]) {
+      return false;
+    }
+  }
+  return true;
+}
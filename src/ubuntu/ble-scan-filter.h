@@ -0,0 +1,94 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef BLE_SCAN_FILTER_H
+#define BLE_SCAN_FILTER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+#include <QBluetoothUuid>
+
+#include "ble-advertisement.h"
+
+/**
+ * @brief The BleScanFilter class
+ *
+ * Filter program compiled from the scan services and the "filters" scan
+ * option. It is matched against the AD structures of an advertisement in
+ * place, so that only matching devices get serialized.
+ *
+ * The services restrict every match to devices advertising at least one
+ * of them. Each entry of "filters" is a set of conditions that must all
+ * hold, a device matches when any entry does.
+ */
+class BleScanFilter {
+public:
+    BleScanFilter();
+
+    bool compile(const QList<QBluetoothUuid>& services,
+                 const QVariantList& filters,
+                 QString *error);
+    void clear();
+
+    bool isEmpty() const { return _program.isEmpty(); }
+
+    bool matches(const BleAdvertisement& advertisement) const;
+
+private:
+    enum Opcode {
+        AnyService,
+        RssiFloor,
+        NamePrefix,
+        FieldPrefix
+    };
+
+    struct Instruction {
+        quint8 opcode;
+        quint8 adType;
+        qint16 rssi;
+        // value then mask bytes in _bytes, or the UUID list for AnyService
+        int offset;
+        int size;
+    };
+
+    bool compileEntry(const QVariantMap& entry, QString *error);
+    void appendPrefix(quint8 opcode, quint8 adType,
+                      const QByteArray& value, const QByteArray& mask);
+
+    bool execute(const Instruction& instruction,
+                 const BleAdvertisement& advertisement) const;
+    bool matchesService(const Instruction& instruction,
+                        const BleAdvertisement& advertisement) const;
+    bool matchesPrefix(const Instruction& instruction,
+                       const BleAdvertisement::Field& field) const;
+
+    QVector<Instruction> _program;
+    // instructions before this index apply to every entry
+    int _globalCount;
+    // one past the last instruction of each entry
+    QVector<int> _entryEnds;
+    QByteArray _bytes;
+};
+
+#endif // BLE_SCAN_FILTER_H
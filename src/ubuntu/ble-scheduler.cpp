@@ -0,0 +1,352 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-scheduler.h"
+
+#include "ble-json-writer.h"
+#include "ble-peripheral-table.h"
+
+namespace {
+
+const char *const kPriorityNames[] = {
+  "control",
+  "interactive",
+  "bulk"
+};
+
+// share of the adapter of a flow of each class, relative to bulk
+const double kWeights[] = {
+  16,
+  4,
+  1
+};
+
+// cost of an operation on top of the bytes it writes, about one ATT PDU
+const int kOperationCost = 20;
+
+}
+
+BleScheduler::BleScheduler(BlePeripheralTable *peripherals)
+  : _peripherals(peripherals),
+    _queued(0),
+    _virtualTime(0),
+    _nextId(1),
+    _dispatching(false) {
+  _clock.start();
+}
+
+bool BleScheduler::fromName(const QString& name, Priority *priority) {
+  for (int i = 0; i < PriorityCount; ++i) {
+    if (name == QLatin1String(kPriorityNames[i])) {
+      *priority = Priority(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *BleScheduler::name(Priority priority) {
+  return kPriorityNames[priority];
+}
+
+/**
+ * @brief BleScheduler::submit
+ *
+ * Queues a job on the flow of the peripheral and class, and starts what
+ * can be started.
+ *
+ * @param peripheral
+ * @param priority
+ * @param operations run back to back on the peripheral
+ */
+void BleScheduler::submit(BlePeripheral *peripheral, Priority priority,
+                          const QList<BlePeripheral::Operation>& operations) {
+  if (operations.isEmpty()) {
+    return;
+  }
+
+  Job job;
+  job.id = _nextId++;
+  job.handle = peripheral->handle();
+  job.priority = priority;
+  job.cost = 0;
+  Q_FOREACH(const BlePeripheral::Operation& operation, operations) {
+    job.cost += kOperationCost + operation.value.size();
+  }
+  job.submitted = now();
+  job.operations = operations;
+
+  Queue& queue = _queues[job.handle];
+  Flow& flow = queue.flows[priority];
+  job.finish = qMax(queue.virtualTime, flow.finish)
+    + job.cost / kWeights[priority];
+  flow.finish = job.finish;
+  flow.jobs.enqueue(job);
+  if (!queue.busy && queue.queued == 0) {
+    ready(queue);
+  }
+  ++queue.queued;
+  ++_queued;
+
+  dispatch();
+}
+
+/**
+ * @brief BleScheduler::cancel
+ *
+ * Fails the jobs of a peripheral still waiting for their turn.
+ *
+ * @param handle of the peripheral
+ * @param error reported to the failure callbacks
+ */
+void BleScheduler::cancel(int handle, const QString& error) {
+  auto it = _queues.find(handle);
+  if (it == _queues.end()) {
+    return;
+  }
+
+  QList<Job> cancelled;
+  for (int i = 0; i < PriorityCount; ++i) {
+    cancelled.append(it->flows[i].jobs);
+    it->flows[i] = Flow();
+  }
+  _queued -= it->queued;
+  it->queued = 0;
+  if (!it->busy) {
+    _queues.erase(it);
+  }
+
+  // failure callbacks may submit again
+  Q_FOREACH(const Job& job, cancelled) {
+    Q_FOREACH(const BlePeripheral::Operation& operation, job.operations) {
+      operation.failure(error);
+    }
+  }
+}
+
+int BleScheduler::Queue::next() const {
+  int best = -1;
+  for (int i = 0; i < PriorityCount; ++i) {
+    if (!flows[i].jobs.isEmpty()
+        && (best < 0
+            || flows[i].jobs.head().finish < flows[best].jobs.head().finish)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+/**
+ * @brief BleScheduler::dispatch
+ *
+ * Starts jobs until MaxInFlight jobs are running or the peripherals with
+ * queued jobs are all busy.
+ */
+void BleScheduler::dispatch() {
+  if (_dispatching) {
+    return;
+  }
+  _dispatching = true;
+
+  // jobs may complete synchronously, loop rather than recurse
+  while (_queued > 0 && _running.size() < MaxInFlight) {
+    auto best = _queues.end();
+    double bestService = 0;
+    for (auto it = _queues.begin(); it != _queues.end(); ++it) {
+      if (it->busy || it->queued == 0) {
+        continue;
+      }
+      const BlePeripheral *peripheral = _peripherals->find(it.key());
+      if (peripheral && !peripheral->isReady()) {
+        continue;
+      }
+      // waiting for a slot keeps the place in line, being busy or idle
+      // does not bank service
+      const Job& head = it->flows[it->next()].jobs.head();
+      const double service =
+        it->eligible + head.cost / kWeights[head.priority];
+      if (best == _queues.end() || service < bestService) {
+        best = it;
+        bestService = service;
+      }
+    }
+    if (best == _queues.end()) {
+      break;
+    }
+
+    const Job job = best->flows[best->next()].jobs.dequeue();
+    best->virtualTime = qMax(best->virtualTime, job.finish);
+    best->service = bestService;
+    best->busy = true;
+    --best->queued;
+    --_queued;
+    _virtualTime = bestService;
+
+    start(job);
+  }
+
+  _dispatching = false;
+}
+
+void BleScheduler::start(const Job& job) {
+  BlePeripheral *peripheral = _peripherals->find(job.handle);
+  if (!peripheral) {
+    finished(job.handle);
+    Q_FOREACH(const BlePeripheral::Operation& operation, job.operations) {
+      // TODO i8n
+      operation.failure(QLatin1String("Peripheral disconnected"));
+    }
+    return;
+  }
+
+  Running running;
+  running.handle = job.handle;
+  running.priority = job.priority;
+  running.remaining = job.operations.size();
+  running.submitted = job.submitted;
+  _running.insert(job.id, running);
+  _stats[job.priority].wait.add(now() - job.submitted);
+
+  const quint64 id = job.id;
+  Q_FOREACH(BlePeripheral::Operation operation, job.operations) {
+    const BlePeripheral::SuccessCallback success = operation.success;
+    const BlePeripheral::ErrorCallback failure = operation.failure;
+    operation.success = [this, id, success](const QByteArray& value) {
+      if (success) {
+        success(value);
+      }
+      operationDone(id);
+    };
+    operation.failure = [this, id, failure](const QString& error) {
+      if (failure) {
+        failure(error);
+      }
+      operationDone(id);
+    };
+    // enqueued together, so nothing else runs in between
+    peripheral->enqueue(operation);
+  }
+}
+
+void BleScheduler::operationDone(quint64 id) {
+  auto it = _running.find(id);
+  if (it == _running.end() || --it->remaining > 0) {
+    return;
+  }
+
+  _stats[it->priority].latency.add(now() - it->submitted);
+  const int handle = it->handle;
+  _running.erase(it);
+  finished(handle);
+
+  dispatch();
+}
+
+// the peripheral is free for its next job
+void BleScheduler::finished(int handle) {
+  auto it = _queues.find(handle);
+  if (it == _queues.end()) {
+    return;
+  }
+  it->busy = false;
+  if (it->queued > 0) {
+    ready(*it);
+    return;
+  }
+  _queues.erase(it);
+  if (_idle) {
+    _idle(handle);
+  }
+}
+
+void BleScheduler::write(BleJsonWriter& writer) const {
+  writer.beginObject();
+  writer.key(QLatin1String("queued"));
+  writer.value(_queued);
+  writer.key(QLatin1String("inFlight"));
+  writer.value(_running.size());
+
+  writer.key(QLatin1String("classes"));
+  writer.beginObject();
+  for (int i = 0; i < PriorityCount; ++i) {
+    const ClassStats& stats = _stats[i];
+    writer.key(QLatin1String(kPriorityNames[i]));
+    writer.beginObject();
+    writer.key(QLatin1String("count"));
+    writer.value(qint64(stats.latency.count));
+    writer.key(QLatin1String("wait"));
+    stats.wait.write(writer);
+    writer.key(QLatin1String("latency"));
+    stats.latency.write(writer);
+    writer.endObject();
+  }
+  writer.endObject();
+
+  writer.endObject();
+}
+
+BleScheduler::Histogram::Histogram()
+  : count(0),
+    sum(0),
+    max(0) {
+  for (quint64& bucket : buckets) {
+    bucket = 0;
+  }
+}
+
+void BleScheduler::Histogram::add(qint64 sample) {
+  sample = qMax(qint64(0), sample);
+  int bucket = 0;
+  while (bucket < BucketCount - 1 && (qint64(1) << bucket) <= sample) {
+    ++bucket;
+  }
+  ++buckets[bucket];
+  ++count;
+  sum += sample;
+  max = qMax(max, sample);
+}
+
+qint64 BleScheduler::Histogram::percentile(double fraction) const {
+  // upper bound of the bucket holding the sample
+  const quint64 rank = quint64(fraction * count + 0.5);
+  quint64 seen = 0;
+  for (int i = 0; i < BucketCount; ++i) {
+    seen += buckets[i];
+    if (seen >= rank && seen > 0) {
+      return qMin(qint64(1) << i, max);
+    }
+  }
+  return max;
+}
+
+// {mean, p50, p99, max} in ms
+void BleScheduler::Histogram::write(BleJsonWriter& writer) const {
+  writer.beginObject();
+  writer.key(QLatin1String("mean"));
+  writer.value(count ? sum / 1000.0 / count : 0.0);
+  writer.key(QLatin1String("p50"));
+  writer.value(percentile(0.5) / 1000.0);
+  writer.key(QLatin1String("p99"));
+  writer.value(percentile(0.99) / 1000.0);
+  writer.key(QLatin1String("max"));
+  writer.value(max / 1000.0);
+  writer.endObject();
+}
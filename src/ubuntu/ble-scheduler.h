@@ -0,0 +1,192 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_SCHEDULER_H
+#define BLE_SCHEDULER_H
+
+#include <functional>
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QQueue>
+#include <QString>
+
+#include "ble-peripheral.h"
+
+class BleJsonWriter;
+class BlePeripheralTable;
+
+/**
+ * @brief The BleScheduler class
+ *
+ * Plugin-wide scheduler of the GATT operations of all connected
+ * peripherals, above their own operation queues.
+ *
+ * Operations are submitted in jobs, one operation or a batch run back to
+ * back, each with a priority class. A peripheral runs one job at a time
+ * and at most MaxInFlight jobs run across peripherals, so that waiting
+ * work stays here, where it can be reordered.
+ *
+ * Both choices are weighted fair queuing, self-clocked: the next job of a
+ * peripheral is the one of its classes with the smallest virtual finish
+ * time, and a free slot goes to the idle peripheral whose next job would
+ * finish first in the shared virtual time. Weights come from the class,
+ * costs grow with the bytes written. A bulk transfer therefore gets its
+ * share without delaying control writes, to the same peripheral or to
+ * others, by more than about one operation.
+ */
+class BleScheduler {
+public:
+    enum Priority {
+        Control,
+        Interactive,
+        Bulk
+    };
+
+    static const int PriorityCount = Bulk + 1;
+    static const int MaxInFlight = 4;
+
+    typedef std::function<void(int handle)> IdleCallback;
+
+    explicit BleScheduler(BlePeripheralTable *peripherals);
+
+    static bool fromName(const QString& name, Priority *priority);
+    static const char *name(Priority priority);
+
+    void submit(BlePeripheral *peripheral, Priority priority,
+                const QList<BlePeripheral::Operation>& operations);
+    void submit(BlePeripheral *peripheral, Priority priority,
+                const BlePeripheral::Operation& operation) {
+        submit(peripheral, priority,
+               QList<BlePeripheral::Operation>() << operation);
+    }
+    // Fails the queued jobs of a peripheral, not the running one.
+    void cancel(int handle, const QString& error);
+    // Starts the jobs of peripherals that got ready.
+    void resume() { dispatch(); }
+
+    // Jobs of peripherals that are not ready wait, without taking a slot.
+    bool hasJobs(int handle) const { return _queues.contains(handle); }
+    // Called when a peripheral has no job left.
+    void setIdleCallback(const IdleCallback& idle) { _idle = idle; }
+
+    int queued() const { return _queued; }
+    int inFlight() const { return _running.size(); }
+
+    // {queued, inFlight, classes: {name: {count, wait, latency}}}
+    void write(BleJsonWriter& writer) const;
+
+private:
+    struct Job {
+        quint64 id;
+        int handle;
+        Priority priority;
+        double cost;
+        // in the virtual time of the peripheral
+        double finish;
+        qint64 submitted;
+        QList<BlePeripheral::Operation> operations;
+    };
+
+    struct Flow {
+        Flow() : finish(0) {}
+
+        // finish time of the last job queued
+        double finish;
+        QQueue<Job> jobs;
+    };
+
+    // jobs of a peripheral
+    struct Queue {
+        Queue()
+          : virtualTime(0), service(0), eligible(0), queued(0), busy(false) {}
+
+        // flow with the smallest finish time at its head, -1 if none
+        int next() const;
+
+        // finish time of the last job started, for the classes
+        double virtualTime;
+        // finish time of the last job started, in the shared virtual time
+        double service;
+        // shared virtual time the peripheral got ready for its next job at
+        double eligible;
+        int queued;
+        bool busy;
+        Flow flows[PriorityCount];
+    };
+
+    struct Running {
+        int handle;
+        Priority priority;
+        int remaining;
+        qint64 submitted;
+    };
+
+    // latency distribution, in µs
+    struct Histogram {
+        // bucket n counts the samples below 2^n µs
+        static const int BucketCount = 32;
+
+        Histogram();
+        void add(qint64 sample);
+        qint64 percentile(double fraction) const;
+        void write(BleJsonWriter& writer) const;
+
+        quint64 count;
+        qint64 sum;
+        qint64 max;
+        quint64 buckets[BucketCount];
+    };
+
+    struct ClassStats {
+        // submitted to started
+        Histogram wait;
+        // submitted to completed
+        Histogram latency;
+    };
+
+    void dispatch();
+    void start(const Job& job);
+    void operationDone(quint64 id);
+    void finished(int handle);
+    void ready(Queue& queue) const {
+        queue.eligible = qMax(_virtualTime, queue.service);
+    }
+    qint64 now() const { return _clock.nsecsElapsed() / 1000; }
+
+    BlePeripheralTable *_peripherals;
+    QElapsedTimer _clock;
+
+    // peripherals with queued or running jobs, by handle
+    QHash<int, Queue> _queues;
+    QHash<quint64, Running> _running;
+    int _queued;
+    // shared virtual time, the service tag of the last job started
+    double _virtualTime;
+    quint64 _nextId;
+    bool _dispatching;
+
+    ClassStats _stats[PriorityCount];
+    IdleCallback _idle;
+};
+
+#endif // BLE_SCHEDULER_H
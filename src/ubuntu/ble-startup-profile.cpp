@@ -0,0 +1,67 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+
+#include "ble-startup-profile.h"
+
+#include "ble-json-writer.h"
+
+namespace {
+
+// indexed by BleStartupProfile::Stage
+const char *const kStageNames[] = {
+  "plugin",
+  "discoveryAgent",
+  "localDevice"
+};
+
+}
+
+BleStartupProfile::BleStartupProfile() {
+  _clock.start();
+}
+
+void BleStartupProfile::record(Stage stage, qint64 started) {
+  Timing& timing = _stages[stage];
+  timing.done = true;
+  timing.at = now();
+  timing.duration = timing.at - started;
+}
+
+void BleStartupProfile::write(BleJsonWriter& writer) const {
+  writer.beginObject();
+  for (int i = 0; i < StageCount; ++i) {
+    writer.key(QLatin1String(kStageNames[i]));
+    const Timing& timing = _stages[i];
+    if (!timing.done) {
+      // not built yet
+      writer.null();
+      continue;
+    }
+    writer.beginObject();
+    writer.key(QLatin1String("at"));
+    writer.value(timing.at / 1000.0);
+    writer.key(QLatin1String("duration"));
+    writer.value(timing.duration / 1000.0);
+    writer.endObject();
+  }
+  writer.endObject();
+}
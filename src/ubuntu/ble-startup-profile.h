@@ -0,0 +1,73 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_STARTUP_PROFILE_H
+#define BLE_STARTUP_PROFILE_H
+
+#include <QElapsedTimer>
+
+class BleJsonWriter;
+
+/**
+ * @brief The BleStartupProfile class
+ *
+ * When the plugin objects got built and what they cost, to measure what
+ * the plugin adds to the start of the app. The clock starts when the
+ * profile is constructed, so it is the first member of the plugin.
+ */
+class BleStartupProfile {
+public:
+    enum Stage {
+        // the plugin constructor, from its first member
+        Plugin,
+        DiscoveryAgent,
+        LocalDevice
+    };
+
+    static const int StageCount = LocalDevice + 1;
+
+    BleStartupProfile();
+
+    // µs since the plugin started loading
+    qint64 now() const { return _clock.nsecsElapsed() / 1000; }
+
+    // Records a stage that started at started, µs of now().
+    void record(Stage stage, qint64 started);
+    bool isDone(Stage stage) const { return _stages[stage].done; }
+
+    // {"plugin": {"at": ms, "duration": ms}, "discoveryAgent": null, ...}
+    void write(BleJsonWriter& writer) const;
+
+private:
+    struct Timing {
+        Timing() : done(false), at(0), duration(0) {}
+
+        bool done;
+        // µs since load at the end of the stage
+        qint64 at;
+        qint64 duration;
+    };
+
+    QElapsedTimer _clock;
+    Timing _stages[StageCount];
+};
+
+#endif // BLE_STARTUP_PROFILE_H
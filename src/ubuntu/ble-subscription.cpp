@@ -0,0 +1,275 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-subscription.h"
+
+#include <cmath>
+
+#include "ble-timer-wheel.h"
+
+BleSubscription::BleSubscription(const Sink& sink, Counters *totals)
+  : _sink(sink),
+    _deliver(true),
+    _format(BleDecoder::Raw),
+    _offset(0),
+    _scale(1.0),
+    _field(0),
+    _deadband(-1),
+    _threshold(0),
+    _hasThreshold(false),
+    _minInterval(-1),
+    _maxInterval(-1),
+    _timers(Q_NULLPTR),
+    _windowDeadline(0),
+    _hasDelivered(false),
+    _lastDelivery(0),
+    _lastValue(0),
+    _totals(totals) {
+  _clock.start();
+}
+
+BleSubscription::~BleSubscription() {
+  if (_windowDeadline) {
+    _timers->cancel(_windowDeadline);
+  }
+}
+
+bool BleSubscription::configure(const QVariantMap& options, QString *error) {
+  if (options.contains("decoder")
+      && !BleDecoder::fromName(options.value("decoder").toString(),
+                               &_format)) {
+    // TODO i8n
+    *error = QString("Unknown decoder %1")
+      .arg(options.value("decoder").toString());
+    return false;
+  }
+
+  _deliver = options.value("deliver", true).toBool();
+  _offset = qMax(0, options.value("offset", 0).toInt());
+  _scale = options.value("scale", 1.0).toDouble();
+
+  _field = options.value("field", 0).toInt();
+  if (_field < 0 || _field >= BleDecoder::MaxValues) {
+    // TODO i8n
+    *error = QString("Invalid field %1").arg(_field);
+    return false;
+  }
+  _deadband = options.value("deadband", -1).toDouble();
+  _hasThreshold = options.contains("threshold");
+  _threshold = options.value("threshold", 0).toDouble();
+  _minInterval = options.value("minInterval", -1).toLongLong();
+  _maxInterval = options.value("maxInterval", -1).toLongLong();
+
+  _aggregator.setWindow(options.value("window", 0).toLongLong());
+
+  const bool valueFilters = _deadband >= 0 || _hasThreshold;
+  if ((valueFilters || _aggregator.isEnabled())
+      && _format == BleDecoder::Raw) {
+    // TODO i8n
+    *error = QLatin1String("deadband, threshold and window need a decoder");
+    return false;
+  }
+  if (_aggregator.isEnabled()
+      && (valueFilters || _minInterval >= 0 || _maxInterval >= 0)) {
+    // TODO i8n
+    *error = QLatin1String("window can not be combined with other filters");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief BleSubscription::deliver
+ *
+ * Called for every notification of the characteristic.
+ *
+ * @param data characteristic value
+ * @param writer message buffer shared by the subscriptions of the
+ *        peripheral
+ */
+void BleSubscription::deliver(const QByteArray& data, BleJsonWriter& writer) {
+  if (_tap) {
+    countDelivered();
+    _tap(data);
+    return;
+  }
+  if (!_deliver) {
+    countFiltered();
+    return;
+  }
+
+  int count = 0;
+  if (_format != BleDecoder::Raw) {
+    const int size = data.size() - _offset;
+    if (size > 0) {
+      count = BleDecoder::decode(
+        _format,
+        reinterpret_cast<const uchar *>(data.constData()) + _offset,
+        size,
+        _values);
+    }
+    if (count == 0) {
+      countMalformed();
+      return;
+    }
+    for (int i = 0; i < count; ++i) {
+      _values[i] *= _scale;
+    }
+  }
+
+  if (_aggregator.isEnabled()) {
+    // samples are counted as filtered, summaries as delivered
+    countFiltered();
+    const qint64 now = _clock.elapsed();
+    if (_aggregator.add(now, _values, count)) {
+      sendSummary();
+    }
+    scheduleWindowEnd(now);
+    return;
+  }
+
+  if (!accept(count)) {
+    countFiltered();
+    return;
+  }
+  countDelivered();
+
+  writer.reset();
+  if (_format == BleDecoder::Raw) {
+    writer.base64(data.constData(), data.size());
+  } else {
+    writer.beginArray();
+    for (int i = 0; i < count; ++i) {
+      writer.value(_values[i]);
+    }
+    writer.endArray();
+  }
+  _sink(writer.text());
+}
+
+/**
+ * @brief BleSubscription::flush
+ *
+ * Sends the summary of the window in progress, if it holds samples.
+ */
+void BleSubscription::flush() {
+  if (_aggregator.flush(_clock.elapsed())) {
+    sendSummary();
+  }
+}
+
+void BleSubscription::sendSummary() {
+  countDelivered();
+  _summaries.reset();
+  _aggregator.write(_summaries);
+  _sink(_summaries.text());
+}
+
+void BleSubscription::scheduleWindowEnd(qint64 now) {
+  if (!_timers || _windowDeadline || !_aggregator.hasSamples()) {
+    return;
+  }
+  const qint64 timeout = qMax(qint64(1), _aggregator.windowEnd() - now);
+  _windowDeadline = _timers->schedule(int(timeout), [this]() {
+      windowEnded();
+    });
+}
+
+void BleSubscription::windowEnded() {
+  _windowDeadline = 0;
+  const qint64 now = _clock.elapsed();
+  if (_aggregator.hasSamples() && now >= _aggregator.windowEnd()) {
+    // no sample came after the window to close it
+    _aggregator.flush(now);
+    sendSummary();
+  }
+  // a sample closed it, the window it opened ends later
+  scheduleWindowEnd(now);
+}
+
+void BleSubscription::countFiltered() {
+  ++_counters.filtered;
+  if (_totals) {
+    ++_totals->filtered;
+  }
+}
+
+void BleSubscription::countDelivered() {
+  ++_counters.delivered;
+  if (_totals) {
+    ++_totals->delivered;
+  }
+}
+
+void BleSubscription::countMalformed() {
+  ++_counters.malformed;
+  if (_totals) {
+    ++_totals->malformed;
+  }
+}
+
+/**
+ * @brief BleSubscription::accept
+ *
+ * Runs the filters on the decoded values and updates the filter state.
+ *
+ * @param count number of decoded values
+ * @return true if the sample should be delivered
+ */
+bool BleSubscription::accept(int count) {
+  const qint64 now = _clock.elapsed();
+  const qint64 sinceDelivery = now - _lastDelivery;
+
+  bool pass = true;
+  if (_deadband >= 0 || _hasThreshold) {
+    // a sample without the field only passes the interval filters
+    const double value = _field < count ? _values[_field] : NAN;
+
+    pass = !_hasDelivered;
+    if (_deadband >= 0 && std::fabs(value - _lastValue) >= _deadband) {
+      pass = true;
+    }
+    // compared with the last delivered value, a crossing dropped by
+    // minInterval is delivered with the next sample
+    if (_hasThreshold && !std::isnan(value)
+        && (value >= _threshold) != (_lastValue >= _threshold)) {
+      pass = true;
+    }
+  }
+  if (pass && _hasDelivered && _minInterval >= 0
+      && sinceDelivery < _minInterval) {
+    pass = false;
+  }
+  if (!pass && _hasDelivered && _maxInterval >= 0
+      && sinceDelivery >= _maxInterval) {
+    pass = true;
+  }
+  if (!pass) {
+    return false;
+  }
+
+  _hasDelivered = true;
+  _lastDelivery = now;
+  if (_field < count && !std::isnan(_values[_field])) {
+    _lastValue = _values[_field];
+  }
+  return true;
+}
@@ -0,0 +1,145 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef BLE_SUBSCRIPTION_H
+#define BLE_SUBSCRIPTION_H
+
+#include <functional>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QVariant>
+
+#include "ble-aggregator.h"
+#include "ble-decoder.h"
+#include "ble-json-writer.h"
+
+class BleTimerWheel;
+
+/**
+ * @brief The BleSubscription class
+ *
+ * Notification subscription on one characteristic. Turns each
+ * notification payload into a callback message, either the base64
+ * encoded value or the values of a decoded format.
+ *
+ * Samples can be filtered natively so that slowly changing values do not
+ * cross the bridge on every notification.
+ */
+class BleSubscription {
+public:
+    typedef std::function<void(const QString& message)> Sink;
+    typedef std::function<void(const QByteArray& data)> Tap;
+
+    struct Counters {
+        Counters() : delivered(0), filtered(0), malformed(0) {}
+
+        quint64 delivered;
+        quint64 filtered;
+        // payloads too short for the decoder, neither delivered nor
+        // filtered
+        quint64 malformed;
+    };
+
+    // totals, if not null, is updated along with the own counters
+    explicit BleSubscription(const Sink& sink, Counters *totals = Q_NULLPTR);
+    ~BleSubscription();
+
+    /**
+     * Accepted options, all optional:
+     *   decoder: name of a BleDecoder format, "raw" by default
+     *   offset: bytes to skip before decoding
+     *   scale: factor applied to decoded values
+     *   field: index of the decoded value the value filters look at
+     *   deadband: drops samples closer than this to the last delivered one
+     *   threshold: only delivers samples crossing this value
+     *   minInterval: drops samples less than this many ms after the last
+     *                delivered one
+     *   maxInterval: delivers a sample at least every this many ms,
+     *                even if the value filters would drop it
+     *   deliver: false to count the notifications without delivering
+     *            them, for recording
+     *   window: summarizes the decoded values over windows of this many
+     *           ms instead of delivering every sample
+     * deadband, threshold and window need a decoder, window can not be
+     * combined with the other filters.
+     */
+    bool configure(const QVariantMap& options, QString *error);
+
+    // Messages are written with writer, which is reset first.
+    void deliver(const QByteArray& data, BleJsonWriter& writer);
+
+    // A window that ends without a sample after it is summarized at its
+    // end, driven by timers.
+    void setTimerWheel(BleTimerWheel *timers) { _timers = timers; }
+    // Sends the summary of the samples of a window not closed yet, before
+    // the subscription is dropped.
+    void flush();
+
+    // Hands every payload to tap instead of formatting messages for the
+    // sink, the options do not apply.
+    void setTap(const Tap& tap) { _tap = tap; }
+
+    const Counters& counters() const { return _counters; }
+
+private:
+    bool accept(int count);
+    void countFiltered();
+    void countDelivered();
+    void countMalformed();
+    void sendSummary();
+    void scheduleWindowEnd(qint64 now);
+    void windowEnded();
+
+    Sink _sink;
+    Tap _tap;
+
+    bool _deliver;
+    BleDecoder::Format _format;
+    int _offset;
+    double _scale;
+
+    // deadband and intervals are disabled when negative
+    int _field;
+    double _deadband;
+    double _threshold;
+    bool _hasThreshold;
+    qint64 _minInterval;
+    qint64 _maxInterval;
+    BleAggregator _aggregator;
+    // window summaries, also sent outside of deliver()
+    BleJsonWriter _summaries;
+    BleTimerWheel *_timers;
+    quint64 _windowDeadline;
+
+    // filter state
+    QElapsedTimer _clock;
+    bool _hasDelivered;
+    qint64 _lastDelivery;
+    double _lastValue;
+
+    Counters _counters;
+    Counters *_totals;
+
+    double _values[BleDecoder::MaxValues];
+};
+
+#endif // BLE_SUBSCRIPTION_H
@@ -0,0 +1,107 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-timer-wheel.h"
+
+BleTimerWheel::BleTimerWheel()
+  : _tick(0),
+    _nextHandle(1),
+    _slots(SlotCount) {
+  _timer.setInterval(TickInterval);
+  QObject::connect(&_timer, &QTimer::timeout, [this]() {
+      advance();
+    });
+  _clock.start();
+}
+
+BleTimerWheel::Handle BleTimerWheel::schedule(int timeout,
+                                              const Callback& callback) {
+  if (_deadlines.isEmpty()) {
+    // the wheel stood still, catch up without processing empty slots
+    _tick = _clock.elapsed() / TickInterval;
+    _timer.start();
+  }
+
+  const qint64 now = _clock.elapsed() / TickInterval;
+  // rounded up, a deadline never expires early, and always lands in a
+  // slot still to be processed
+  const qint64 ticks = (qMax(0, timeout) + TickInterval - 1) / TickInterval;
+  const qint64 tick = qMax(now, _tick) + qMax(qint64(1), ticks);
+
+  const Handle handle = _nextHandle++;
+  _deadlines.insert(handle, Deadline { tick, callback });
+  _slots[int(tick % SlotCount)].append(handle);
+  return handle;
+}
+
+void BleTimerWheel::cancel(Handle handle) {
+  _deadlines.remove(handle);
+  if (_deadlines.isEmpty()) {
+    _timer.stop();
+    for (QVector<Handle>& slot : _slots) {
+      slot.clear();
+    }
+  }
+}
+
+/**
+ * @brief BleTimerWheel::advance
+ *
+ * Processes the slots of the ticks elapsed since the last call, calling
+ * the callbacks of the expired deadlines.
+ */
+void BleTimerWheel::advance() {
+  const qint64 now = _clock.elapsed() / TickInterval;
+
+  for (; _tick <= now && !_deadlines.isEmpty(); ++_tick) {
+    QVector<Handle>& slot = _slots[int(_tick % SlotCount)];
+
+    QVector<Handle> expired;
+    for (int i = 0; i < slot.size(); ) {
+      auto it = _deadlines.find(slot.at(i));
+      if (it == _deadlines.end()) {
+        // cancelled
+        slot.remove(i);
+      } else if (it->tick <= _tick) {
+        expired.append(slot.at(i));
+        slot.remove(i);
+      } else {
+        // a later turn of the wheel
+        ++i;
+      }
+    }
+
+    // callbacks may schedule and cancel deadlines, including expired ones
+    Q_FOREACH(Handle handle, expired) {
+      auto it = _deadlines.find(handle);
+      if (it == _deadlines.end()) {
+        continue;
+      }
+      const Callback callback = it->callback;
+      _deadlines.erase(it);
+      callback();
+    }
+  }
+
+  if (_deadlines.isEmpty()) {
+    _timer.stop();
+  }
+}
@@ -0,0 +1,78 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_TIMER_WHEEL_H
+#define BLE_TIMER_WHEEL_H
+
+#include <functional>
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QTimer>
+#include <QVector>
+
+/**
+ * @brief The BleTimerWheel class
+ *
+ * Deadlines of the plugin, driven by one shared timer. Deadlines are
+ * hashed into the slots of a wheel by the tick they expire at; the timer
+ * runs only while deadlines are pending. Scheduling and cancelling do not
+ * touch the timer.
+ */
+class BleTimerWheel {
+public:
+    typedef quint64 Handle;
+    typedef std::function<void()> Callback;
+
+    // resolution of the deadlines, in ms
+    static const int TickInterval = 10;
+    static const int SlotCount = 256;
+
+    BleTimerWheel();
+
+    // Calls callback once, timeout ms from now. Never returns 0.
+    Handle schedule(int timeout, const Callback& callback);
+    // Drops a pending deadline, does nothing if it already expired.
+    void cancel(Handle handle);
+
+    int pending() const { return _deadlines.size(); }
+
+private:
+    struct Deadline {
+        qint64 tick;
+        Callback callback;
+    };
+
+    void advance();
+
+    QTimer _timer;
+    QElapsedTimer _clock;
+    // next tick to process
+    qint64 _tick;
+    Handle _nextHandle;
+
+    QHash<Handle, Deadline> _deadlines;
+    // handles of the deadlines expiring in a tick of the slot,
+    // cancelled ones are skipped when the slot is processed
+    QVector<QVector<Handle> > _slots;
+};
+
+#endif // BLE_TIMER_WHEEL_H
@@ -0,0 +1,290 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+*/
+
+#include "ble-trace.h"
+
+#include <algorithm>
+
+namespace {
+
+const char kMagic[8] = { 'B', 'L', 'E', 'T', 'R', 'C', '0', '1' };
+
+}
+
+BleTrace::Event::Event()
+  : type(ScanResultEvent),
+    time(0),
+    address(0),
+    rssi(0),
+    operation(0),
+    ok(true),
+    duration(0) {
+}
+
+BleTrace::BleTrace()
+  : _events(0) {
+}
+
+BleTrace::~BleTrace() {
+  stop();
+}
+
+/**
+ * @brief BleTrace::start
+ *
+ * Creates the trace file, a trace in progress is stopped.
+ *
+ * @param path trace file, overwritten
+ * @param error set if the file can not be created
+ * @return true if tracing
+ */
+bool BleTrace::start(const QString& path, QString *error) {
+  stop();
+
+  _file.setFileName(path);
+  if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+      || _file.write(kMagic, sizeof(kMagic)) != qint64(sizeof(kMagic))) {
+    // TODO i8n
+    *error = QString("Could not create trace file %1").arg(path);
+    _file.close();
+    return false;
+  }
+
+  _stream.setDevice(&_file);
+  _stream.setVersion(QDataStream::Qt_5_0);
+  _events = 0;
+  _clock.start();
+  return true;
+}
+
+void BleTrace::stop() {
+  if (!_file.isOpen()) {
+    return;
+  }
+  _stream.setDevice(Q_NULLPTR);
+  _file.close();
+}
+
+void BleTrace::scanResult(const QBluetoothDeviceInfo& deviceInfo) {
+  if (!isTracing()) {
+    return;
+  }
+
+  Event event;
+  event.type = ScanResultEvent;
+  event.time = now();
+  event.address = deviceInfo.address().toUInt64();
+  event.name = deviceInfo.name();
+  event.rssi = deviceInfo.rssi();
+  QBluetoothDeviceInfo::DataCompleteness completeness;
+  event.serviceUuids = deviceInfo.serviceUuids(&completeness);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+  event.manufacturerData = deviceInfo.manufacturerData();
+#endif
+  write(event);
+}
+
+void BleTrace::connected(quint64 address, qint64 started,
+                         const QString& peripheral) {
+  if (!isTracing()) {
+    return;
+  }
+
+  Event event;
+  event.type = ConnectedEvent;
+  event.time = started;
+  event.address = address;
+  event.text = peripheral;
+  event.duration = now() - started;
+  write(event);
+}
+
+void BleTrace::connectFailed(quint64 address, qint64 started,
+                             const QString& error) {
+  if (!isTracing()) {
+    return;
+  }
+
+  Event event;
+  event.type = ConnectFailedEvent;
+  event.time = started;
+  event.address = address;
+  event.ok = false;
+  event.text = error;
+  event.duration = now() - started;
+  write(event);
+}
+
+void BleTrace::disconnected(quint64 address) {
+  if (!isTracing()) {
+    return;
+  }
+
+  Event event;
+  event.type = DisconnectedEvent;
+  event.time = now();
+  event.address = address;
+  write(event);
+}
+
+void BleTrace::operation(quint64 address, qint64 started, int type,
+                         const QBluetoothUuid& service,
+                         const QBluetoothUuid& characteristic,
+                         const QBluetoothUuid& descriptor,
+                         bool ok, const QByteArray& value,
+                         const QString& error) {
+  if (!isTracing()) {
+    return;
+  }
+
+  Event event;
+  event.type = OperationEvent;
+  event.time = started;
+  event.address = address;
+  event.operation = type;
+  event.service = service;
+  event.characteristic = characteristic;
+  event.descriptor = descriptor;
+  event.ok = ok;
+  event.value = value;
+  event.text = error;
+  event.duration = now() - started;
+  write(event);
+}
+
+void BleTrace::notification(quint64 address,
+                            const QBluetoothUuid& service,
+                            const QBluetoothUuid& characteristic,
+                            const QByteArray& value) {
+  if (!isTracing()) {
+    return;
+  }
+
+  Event event;
+  event.type = NotificationEvent;
+  event.time = now();
+  event.address = address;
+  event.service = service;
+  event.characteristic = characteristic;
+  event.value = value;
+  write(event);
+}
+
+void BleTrace::write(const Event& event) {
+  _stream << quint8(event.type) << event.time << event.address;
+
+  switch (event.type) {
+  case ScanResultEvent:
+    _stream << event.name << event.rssi << event.serviceUuids
+            << event.manufacturerData;
+    break;
+  case ConnectedEvent:
+  case ConnectFailedEvent:
+    _stream << event.ok << event.text << event.duration;
+    break;
+  case DisconnectedEvent:
+    break;
+  case OperationEvent:
+    _stream << qint32(event.operation)
+            << event.service << event.characteristic << event.descriptor
+            << event.ok << event.value << event.text << event.duration;
+    break;
+  case NotificationEvent:
+    _stream << event.service << event.characteristic << event.value;
+    break;
+  }
+  ++_events;
+}
+
+/**
+ * @brief BleTrace::load
+ *
+ * Reads all events of a trace file. Connections and operations are
+ * recorded when they end, events are sorted by their start time.
+ *
+ * @param path trace file
+ * @param events set to the events of the trace
+ * @param error set if the file is not a trace
+ * @return true if the trace was read
+ */
+bool BleTrace::load(const QString& path,
+                    QVector<Event> *events,
+                    QString *error) {
+  QFile file(path);
+  char magic[sizeof(kMagic)];
+  if (!file.open(QIODevice::ReadOnly)
+      || file.read(magic, sizeof(magic)) != qint64(sizeof(magic))
+      || !std::equal(magic, magic + sizeof(magic), kMagic)) {
+    // TODO i8n
+    *error = QString("Could not read trace file %1").arg(path);
+    return false;
+  }
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_5_0);
+
+  events->clear();
+  while (!stream.atEnd()) {
+    Event event;
+    quint8 type;
+    stream >> type >> event.time >> event.address;
+    event.type = EventType(type);
+
+    switch (event.type) {
+    case ScanResultEvent:
+      stream >> event.name >> event.rssi >> event.serviceUuids
+             >> event.manufacturerData;
+      break;
+    case ConnectedEvent:
+    case ConnectFailedEvent:
+      stream >> event.ok >> event.text >> event.duration;
+      break;
+    case DisconnectedEvent:
+      break;
+    case OperationEvent: {
+      qint32 operation;
+      stream >> operation
+             >> event.service >> event.characteristic >> event.descriptor
+             >> event.ok >> event.value >> event.text >> event.duration;
+      event.operation = operation;
+      break;
+    }
+    case NotificationEvent:
+      stream >> event.service >> event.characteristic >> event.value;
+      break;
+    default:
+      stream.setStatus(QDataStream::ReadCorruptData);
+      break;
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+      // a trace cut short keeps its complete events
+      break;
+    }
+    events->append(event);
+  }
+
+  std::stable_sort(events->begin(), events->end(),
+                   [](const Event& a, const Event& b) {
+                     return a.time < b.time;
+                   });
+  return true;
+}
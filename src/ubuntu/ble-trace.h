@@ -0,0 +1,132 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#ifndef BLE_TRACE_H
+#define BLE_TRACE_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+
+/**
+ * @brief The BleTrace class
+ *
+ * Records what happened on the link into a binary trace file: scan
+ * results, connections and every GATT operation and notification, with
+ * their timing. Traces are replayed by BleReplay.
+ *
+ * The file is the magic "BLETRC01" followed by a QDataStream (Qt 5.0
+ * format) of events. Every event starts with its type, its time in us
+ * since the start of the trace and the device address.
+ */
+class BleTrace {
+public:
+    enum EventType {
+        ScanResultEvent = 1,
+        ConnectedEvent,
+        ConnectFailedEvent,
+        DisconnectedEvent,
+        OperationEvent,
+        NotificationEvent
+    };
+
+    struct Event {
+        Event();
+
+        EventType type;
+        // us since the start of the trace
+        qint64 time;
+        quint64 address;
+
+        // ScanResultEvent
+        QString name;
+        qint16 rssi;
+        QList<QBluetoothUuid> serviceUuids;
+        QHash<quint16, QByteArray> manufacturerData;
+
+        // OperationEvent, a BlePeripheral::OperationType
+        int operation;
+        // OperationEvent and NotificationEvent
+        QBluetoothUuid service;
+        QBluetoothUuid characteristic;
+        QBluetoothUuid descriptor;
+        QByteArray value;
+
+        // OperationEvent and connection events
+        bool ok;
+        // peripheral JSON of ConnectedEvent, error of failed events
+        QString text;
+        // us from the start of the operation or connection to its end
+        qint64 duration;
+    };
+
+    BleTrace();
+    ~BleTrace();
+
+    bool start(const QString& path, QString *error);
+    void stop();
+    bool isTracing() const { return _file.isOpen(); }
+
+    quint64 events() const { return _events; }
+
+    // Current trace time in us, the start time of connections and operations.
+    qint64 now() const { return _clock.nsecsElapsed() / 1000; }
+
+    void scanResult(const QBluetoothDeviceInfo& deviceInfo);
+    void connected(quint64 address, qint64 started,
+                   const QString& peripheral);
+    void connectFailed(quint64 address, qint64 started,
+                       const QString& error);
+    void disconnected(quint64 address);
+    // value is the read value, or the error if the operation failed
+    void operation(quint64 address, qint64 started, int type,
+                   const QBluetoothUuid& service,
+                   const QBluetoothUuid& characteristic,
+                   const QBluetoothUuid& descriptor,
+                   bool ok, const QByteArray& value, const QString& error);
+    void notification(quint64 address,
+                      const QBluetoothUuid& service,
+                      const QBluetoothUuid& characteristic,
+                      const QByteArray& value);
+
+    // Reads a trace file, events are in time order.
+    static bool load(const QString& path,
+                     QVector<Event> *events,
+                     QString *error);
+
+private:
+    void write(const Event& event);
+
+    QFile _file;
+    QDataStream _stream;
+    QElapsedTimer _clock;
+    quint64 _events;
+};
+
+#endif // BLE_TRACE_H
@@ -23,11 +23,18 @@
 
 #include <memory>
 
+#include <QDir>
 #include <QObject>
+#include <QStandardPaths>
+#include <QVector>
 
 #include <QBluetoothLocalDevice>
 #include <QBluetoothUuid>
 
+#include <QLowEnergyCharacteristic>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
+#include <QLowEnergyConnectionParameters>
+#endif
 #include <QLowEnergyDescriptor>
 #include <QLowEnergyService>
 
@@ -36,6 +43,9 @@
 
 #include <cordova.h>
 
+#include "ble-resource-usage.h"
+#include "ble-uuid.h"
+
 namespace {
 
 bool isBleDevice(QFlags<QBluetoothDeviceInfo::CoreConfiguration> cc) {
@@ -43,57 +53,110 @@ bool isBleDevice(QFlags<QBluetoothDeviceInfo::CoreConfiguration> cc) {
       || cc.testFlag(QBluetoothDeviceInfo::BaseRateAndLowEnergyCoreConfiguration);
 }
 
-QString serviceClassesToString(QFlags<QBluetoothDeviceInfo::ServiceClass> sc) {
-  // TODO i8n
-  QStringList result;
-
-  if (sc.testFlag(QBluetoothDeviceInfo::NoService))
-    result << QLatin1String("NoService");
-
-  if (sc.testFlag(QBluetoothDeviceInfo::PositioningService))
-    result << QLatin1String("PositioningService");
-
-  if (sc.testFlag(QBluetoothDeviceInfo::NetworkingService))
-    result << QLatin1String("NetworkingService");
-
-  if (sc.testFlag(QBluetoothDeviceInfo::RenderingService))
-    result << QLatin1String("RenderingService");
-
-  if (sc.testFlag(QBluetoothDeviceInfo::CapturingService))
-    result << QLatin1String("CapturingService");
-
-  if (sc.testFlag(QBluetoothDeviceInfo::ObjectTransferService))
-    result << QLatin1String("ObjectTransferService");
-
-  if (sc.testFlag(QBluetoothDeviceInfo::AudioService))
-    result << QLatin1String("AudioService");
-
-  if (sc.testFlag(QBluetoothDeviceInfo::TelephonyService))
-    result << QLatin1String("TelephonyService");
-
-  if (sc.testFlag(QBluetoothDeviceInfo::InformationService))
-    result << QLatin1String("InformationService");
+struct ServiceClassName {
+  QBluetoothDeviceInfo::ServiceClass flag;
+  const char *name;
+};
+
+// TODO i8n
+const ServiceClassName kServiceClassNames[] = {
+  { QBluetoothDeviceInfo::NoService, "NoService" },
+  { QBluetoothDeviceInfo::PositioningService, "PositioningService" },
+  { QBluetoothDeviceInfo::NetworkingService, "NetworkingService" },
+  { QBluetoothDeviceInfo::RenderingService, "RenderingService" },
+  { QBluetoothDeviceInfo::CapturingService, "CapturingService" },
+  { QBluetoothDeviceInfo::ObjectTransferService, "ObjectTransferService" },
+  { QBluetoothDeviceInfo::AudioService, "AudioService" },
+  { QBluetoothDeviceInfo::TelephonyService, "TelephonyService" },
+  { QBluetoothDeviceInfo::InformationService, "InformationService" },
+  { QBluetoothDeviceInfo::AllServices, "AllServices" }
+};
+
+void writeServiceClasses(BleJsonWriter& writer,
+                         QFlags<QBluetoothDeviceInfo::ServiceClass> sc) {
+  writer.beginString();
+  bool first = true;
+  for (const ServiceClassName& sn : kServiceClassNames) {
+    if (sc.testFlag(sn.flag)) {
+      if (!first) {
+        writer.appendToString(QLatin1String(";"));
+      }
+      writer.appendToString(QLatin1String(sn.name));
+      first = false;
+    }
+  }
+  writer.endString();
+}
 
-  if (sc.testFlag(QBluetoothDeviceInfo::AllServices))
-    result << QLatin1String("AllServices");
+void writeAddress(BleJsonWriter& writer, quint64 address) {
+  // same format as QBluetoothAddress::toString()
+  static const char hex[] = "0123456789ABCDEF";
+  char text[17];
+  for (int i = 0; i < 6; ++i) {
+    const uint byte = (address >> (8 * (5 - i))) & 0xff;
+    text[3 * i] = hex[byte >> 4];
+    text[3 * i + 1] = hex[byte & 0xf];
+    if (i < 5) {
+      text[3 * i + 2] = ':';
+    }
+  }
+  writer.value(QLatin1String(text, sizeof(text)));
+}
 
-  return result.join(";");
+void writeAdvertisement(BleJsonWriter& writer,
+                        const BleAdvertisement& advertisement) {
+  writer.beginObject();
+  writer.key(QLatin1String("name"));
+  writer.value(advertisement.name());
+  // TODO uuid or address?
+  writer.key(QLatin1String("id"));
+  writeAddress(writer, advertisement.address());
+  writer.key(QLatin1String("rssi"));
+  writer.value(int(advertisement.rssi()));
+  writer.key(QLatin1String("advertising"));
+  writer.arrayBuffer(advertisement.data().constData(),
+                     advertisement.data().size());
+  writer.key(QLatin1String("serviceClasses"));
+  writeServiceClasses(writer, advertisement.serviceClasses());
+  writer.endObject();
 }
 
-QString serviceErrorToString(QLowEnergyService::ServiceError error) {
-  switch(error) {
-  case QLowEnergyService::NoError:
-    return QLatin1String("No Error");
-  case QLowEnergyService::OperationError:
-    return QLatin1String("Operation Error");
-  case QLowEnergyService::CharacteristicWriteError:
-    return QLatin1String("Characteristic Write Error");
-  case QLowEnergyService::DescriptorWriteError:
-    return QLatin1String("Descriptor Write Error");
+struct PropertyName {
+  QLowEnergyCharacteristic::PropertyType flag;
+  const char *name;
+};
+
+// same names as the Android implementation
+const PropertyName kPropertyNames[] = {
+  { QLowEnergyCharacteristic::Broadcasting, "Broadcast" },
+  { QLowEnergyCharacteristic::Read, "Read" },
+  { QLowEnergyCharacteristic::WriteNoResponse, "WriteWithoutResponse" },
+  { QLowEnergyCharacteristic::Write, "Write" },
+  { QLowEnergyCharacteristic::Notify, "Notify" },
+  { QLowEnergyCharacteristic::Indicate, "Indicate" },
+  { QLowEnergyCharacteristic::WriteSigned, "AuthenticatedSignedWrites" },
+  { QLowEnergyCharacteristic::ExtendedProperty, "ExtendedProperties" }
+};
+
+QVariantList propertiesToVariant(
+    QLowEnergyCharacteristic::PropertyTypes properties) {
+  QVariantList result;
+  for (const PropertyName& pn : kPropertyNames) {
+    if (properties.testFlag(pn.flag)) {
+      result.append(QLatin1String(pn.name));
+    }
   }
-  return QLatin1String("Unknown");
+  return result;
 }
-  
+
+// path relative to the application data directory
+QString dataFilePath(const QString& path) {
+  const QDir dataDir(
+    QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+  dataDir.mkpath(QLatin1String("."));
+  return dataDir.absoluteFilePath(path);
+}
+
 QBluetoothUuid btUuidFromUuidString(const QString& uuid) {
   QBluetoothUuid btServiceUuid;
   if (uuid.count() > 4) {
@@ -104,12 +167,148 @@ QBluetoothUuid btUuidFromUuidString(const QString& uuid) {
   return btServiceUuid;
 }
 
+QList<QBluetoothUuid> btUuidsFromVariantList(const QVariantList& uuids) {
+  QList<QBluetoothUuid> result;
+  Q_FOREACH(const QVariant& uuid, uuids) {
+    result.append(btUuidFromUuidString(uuid.toString()));
+  }
+  return result;
+}
+
+void writePresenceEvent(BleJsonWriter& writer,
+                        const BlePresence::Event& event,
+                        const BlePresence& presence) {
+  writer.beginObject();
+  writer.key(QLatin1String("event"));
+  writer.value(QLatin1String(BlePresence::eventName(event.type)));
+  writer.key(QLatin1String("id"));
+  writeAddress(writer, event.address);
+  writer.key(QLatin1String("rssi"));
+  writer.value(event.rssi);
+  writer.key(QLatin1String("zone"));
+  if (event.zone == BlePresence::NoZone) {
+    writer.null();
+  } else {
+    writer.value(presence.zoneName(event.zone));
+  }
+  if (event.type == BlePresence::ZoneChange) {
+    writer.key(QLatin1String("previousZone"));
+    if (event.previousZone == BlePresence::NoZone) {
+      writer.null();
+    } else {
+      writer.value(presence.zoneName(event.previousZone));
+    }
+  }
+  writer.endObject();
+}
+
+QVariantMap linkToVariant(const BlePeripheral::Link& link) {
+  QVariantMap l;
+  l.insert("mtu", link.mtu);
+  l.insert("interval", link.interval);
+  l.insert("latency", link.latency);
+  l.insert("supervisionTimeout", link.supervisionTimeout);
+  return l;
+}
+
+void writeLink(BleJsonWriter& writer, const BlePeripheral::Link& link) {
+  writer.beginObject();
+  writer.key(QLatin1String("mtu"));
+  writer.value(link.mtu);
+  writer.key(QLatin1String("interval"));
+  writer.value(link.interval);
+  writer.key(QLatin1String("latency"));
+  writer.value(link.latency);
+  writer.key(QLatin1String("supervisionTimeout"));
+  writer.value(link.supervisionTimeout);
+  writer.endObject();
+}
+
+// a peripheral object of an earlier connection, with the handle and the
+// link of this one
+QString reconnected(const QString& description,
+                    const BlePeripheral *peripheral) {
+  QJsonObject object = QJsonDocument::fromJson(description.toUtf8()).object();
+  object.insert("handle", peripheral->handle());
+  object.insert("link", QJsonObject::fromVariantMap(
+                          linkToVariant(peripheral->link())));
+  return QString::fromUtf8(QJsonDocument(object).toJson());
+}
+
 }
 
 BleCentral::BleCentral(
         Cordova *cordova)
-  : CPlugin(cordova) {
-  _discoveryAgent.reset(new QBluetoothDeviceDiscoveryAgent(this));
+  : CPlugin(cordova),
+    _scanCallbackId(0),
+    _presence(&_timers),
+    _replayScanning(false),
+    _replayCallbackId(0),
+    _connectTimeout(30000),
+    _readTimeout(10000),
+    _writeTimeout(10000),
+    _descriptorTimeout(10000),
+    _scheduler(&_peripherals),
+    _transactions(0) {
+  QObject::connect(&_scanBatchTimer, &QTimer::timeout,
+                   this, &BleCentral::flushScanResults);
+
+  _presence.setCallback([this](const BlePresence::Event& event) {
+      _scanWriter.reset();
+      writePresenceEvent(_scanWriter, event, _presence);
+      this->callbackWithoutRemove(_scanCallbackId, _scanWriter.text());
+    });
+
+  // a link that went idle can make room for a waiting peripheral
+  _scheduler.setIdleCallback([this](int) {
+      if (_linkPool.waiting() > 0) {
+        pumpLinks();
+      }
+    });
+
+  _startup.record(BleStartupProfile::Plugin, 0);
+}
+
+BleCentral::~BleCentral() {
+  // deleting a peripheral fails its pending operations, whose callbacks
+  // reach the scheduler and through it the link pool; the peripherals go
+  // first, while the rest of the plugin is still there
+  _scheduler.setIdleCallback(BleScheduler::IdleCallback());
+  Q_FOREACH(BlePeripheral *peripheral, _peripherals.peripherals()) {
+    delete _peripherals.take(peripheral->handle());
+  }
+  // peripherals already taken out of the table, waiting for deleteLater
+  // or for their link to close, are still children of the plugin
+  qDeleteAll(findChildren<BlePeripheral *>(QString(),
+                                           Qt::FindDirectChildrenOnly));
+}
+
+/**
+ * @brief BleCentral::discoveryAgent
+ *
+ * The discovery agent, built on first use rather than with the plugin.
+ */
+QBluetoothDeviceDiscoveryAgent *BleCentral::discoveryAgent() {
+  if (!_discoveryAgent) {
+    const qint64 started = _startup.now();
+    _discoveryAgent.reset(new QBluetoothDeviceDiscoveryAgent(this));
+    _startup.record(BleStartupProfile::DiscoveryAgent, started);
+  }
+  return _discoveryAgent.data();
+}
+
+/**
+ * @brief BleCentral::localDevice
+ *
+ * The local adapter, built on first use and kept for the next calls.
+ */
+QBluetoothLocalDevice *BleCentral::localDevice() {
+  if (!_localDevice) {
+    const qint64 started = _startup.now();
+    _localDevice.reset(new QBluetoothLocalDevice(this));
+    _startup.record(BleStartupProfile::LocalDevice, started);
+  }
+  return _localDevice.data();
 }
 
 void BleCentral::deviceDiscovered(int cbId,
@@ -120,14 +319,50 @@ void BleCentral::deviceDiscovered(int cbId,
     return;
   }
 
-  QVariantMap p;
-  p.insert("name", deviceInfo.name());
-  // TODO uuid or address?
-  p.insert("id", deviceInfo.address().toString());
-  p.insert("rssi", QString("%1").arg(deviceInfo.rssi()));
-  p.insert("advertising", serviceClassesToString(deviceInfo.serviceClasses()));
+  _trace.scanResult(deviceInfo);
+
+  _advertisement.parse(deviceInfo);
+  if (!_scanFilter.matches(_advertisement)) {
+    return;
+  }
+
+  if (_presence.isEnabled()) {
+    // only the transitions reach the scan callback
+    _presence.update(_advertisement.address(), _advertisement.rssi());
+    return;
+  }
+
+  if (_scanBatchTimer.isActive()) {
+    // only the latest state of each device is kept until the next flush,
+    // the previous record buffer is recycled for the next advertisement
+    ScanResult& result = _scanResults[_advertisement.address()];
+    result.advertisement.swap(_advertisement);
+    result.pending = true;
+    return;
+  }
+
+  _scanWriter.reset();
+  writeAdvertisement(_scanWriter, _advertisement);
+  this->callbackWithoutRemove(cbId, _scanWriter.text());
+}
+
+void BleCentral::flushScanResults() {
+  _scanWriter.reset();
+  _scanWriter.beginArray();
 
-  this->callbackWithoutRemove(cbId, CordovaInternal::format(p));
+  bool empty = true;
+  for (auto it = _scanResults.begin(); it != _scanResults.end(); ++it) {
+    if (it->pending) {
+      writeAdvertisement(_scanWriter, it->advertisement);
+      it->pending = false;
+      empty = false;
+    }
+  }
+
+  _scanWriter.endArray();
+  if (!empty) {
+    this->callbackWithoutRemove(_scanCallbackId, _scanWriter.text());
+  }
 }
 
 void BleCentral::deviceScanError(int cbId,
@@ -137,23 +372,394 @@ void BleCentral::deviceScanError(int cbId,
   this->cb(cbId, "Scan device error");
 }
 
-QVariantMap BleCentral::getConnectedDeviceInfos() {
+/**
+ * @brief BleCentral::peripheralFor
+ *
+ * Looks up the connected peripheral for a GATT call, calling the error
+ * callback if there is none. The error message is only formatted on
+ * failure.
+ *
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @return the peripheral, or a null pointer
+ */
+BlePeripheral *BleCentral::peripheralFor(int ecId, const QString& deviceId) {
+  BlePeripheral *peripheral = _peripherals.find(deviceId);
+  if (!peripheral) {
+    // TODO i8n
+    this->cb(ecId,
+             QString("Not connected to device %1")
+               .arg(deviceId));
+  }
+  return peripheral;
+}
+
+/**
+ * @brief BleCentral::linkFor
+ *
+ * Looks up the peripheral for a GATT call like peripheralFor, but with
+ * the connection pool enabled, a peripheral that is not connected is
+ * queued for a pooled link instead of failing. Its operations wait until
+ * the link is up.
+ *
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @return the peripheral, or a null pointer
+ */
+BlePeripheral *BleCentral::linkFor(int ecId, const QString& deviceId) {
+  BlePeripheral *peripheral = _peripherals.find(deviceId);
+  if (!peripheral && _linkPool.isEnabled() && !_replay) {
+    peripheral = openPooled(deviceId);
+  }
+  if (!peripheral) {
+    return peripheralFor(ecId, deviceId);
+  }
+  _linkPool.touch(peripheral->handle());
+  return peripheral;
+}
+
+/**
+ * @brief BleCentral::openPooled
+ *
+ * Adds a pooled peripheral for a MAC address and queues it for a link.
+ *
+ * @param deviceId MAC address of the peripheral
+ * @return the peripheral, or a null pointer if deviceId is not an address
+ * or the peripheral table is full
+ */
+BlePeripheral *BleCentral::openPooled(const QString& deviceId) {
+  const quint64 address = BlePeripheralTable::parseAddress(deviceId);
+  if (!address || _peripherals.size() == BlePeripheralTable::Capacity) {
+    return Q_NULLPTR;
+  }
+
+  BlePeripheral *peripheral =
+    new BlePeripheral(QBluetoothAddress(address), this);
+  const BlePeripheralTable::Handle handle = _peripherals.insert(peripheral);
+  configurePeripheral(peripheral);
+  peripheral->setReady(false);
+
+  _linkPool.add(handle);
+  _linkPool.wait(handle);
+  _journal.record(BleJournal::ConnectRequested, address);
+  pumpLinks();
+  return peripheral;
+}
+
+/**
+ * @brief BleCentral::links
+ *
+ * Links held or being opened or closed, pooled or not.
+ */
+int BleCentral::links() const {
+  return _peripherals.size() - _linkPool.waiting() + _linkPool.evicting();
+}
+
+/**
+ * @brief BleCentral::isIdle
+ *
+ * A pooled link can be evicted once it is up, with no operation queued
+ * anywhere and no subscription.
+ */
+bool BleCentral::isIdle(int handle) const {
+  const BlePeripheral *peripheral = _peripherals.find(handle);
+  return peripheral
+      && peripheral->isReady()
+      && peripheral->isIdle()
+      && !_scheduler.hasJobs(handle);
+}
+
+/**
+ * @brief BleCentral::pumpLinks
+ *
+ * Opens links for the waiting pooled peripherals while the limit allows,
+ * then evicts the least recently used idle pooled links, one per waiting
+ * peripheral. Runs again when an eviction completes, a link closes or a
+ * peripheral goes idle.
+ */
+void BleCentral::pumpLinks() {
+  while (_linkPool.waiting() > 0) {
+    if (links() < _linkPool.maxLinks()) {
+      if (BlePeripheral *peripheral =
+            _peripherals.find(_linkPool.takeWaiting())) {
+        openLink(peripheral);
+      }
+      continue;
+    }
+    if (_linkPool.evicting() >= _linkPool.waiting()) {
+      return;
+    }
+    const int handle = _linkPool.leastRecentlyUsed(
+        [this](int candidate) { return isIdle(candidate); });
+    if (!handle) {
+      return;
+    }
+    evict(handle);
+  }
+}
+
+/**
+ * @brief BleCentral::openLink
+ *
+ * Connects a pooled peripheral and discovers its primary services, the
+ * service details are discovered on the first operation on each service.
+ *
+ * @param peripheral
+ */
+void BleCentral::openLink(BlePeripheral *peripheral) {
+  const quint64 address = peripheral->address();
+  const BlePeripheralTable::Handle handle = peripheral->handle();
+  QLowEnergyController *controller = peripheral->controller();
+  const qint64 started = _trace.now();
+
+  _linkPool.linkOpened();
+
+  // released once connected, on error and on timeout
+  const BleConnectionPool::Group group = _connections.acquire(controller);
+
+  const BleTimerWheel::Handle timeout = _connectTimeout <= 0 ? 0 :
+    _timers.schedule(_connectTimeout, [=]() {
+        group.release();
+
+        // TODO i8n
+        const QString error = QLatin1String("Connection timed out");
+        _trace.connectFailed(address, started, error);
+        closeLink(handle, error);
+      });
+
+  group.connect(controller,
+                &QLowEnergyController::connected,
+                [=]() {
+                  controller->discoverServices();
+                });
+
+  void (QLowEnergyController::* controllerErrorMethodPtr)(
+        QLowEnergyController::Error)
+    = &QLowEnergyController::error;
+  group.connect(controller,
+                controllerErrorMethodPtr,
+                [=]() {
+                  group.release();
+                  _timers.cancel(timeout);
+
+                  const QString error =
+                    QString("Error: %1").arg(controller->errorString());
+                  _trace.connectFailed(address, started, error);
+                  closeLink(handle, error);
+                });
+
+  group.connect(controller,
+                &QLowEnergyController::discoveryFinished,
+                [=]() {
+                  group.release();
+                  _timers.cancel(timeout);
+
+                  _trace.connected(address, started,
+                                   _linkPool.cached(address));
+                  _journal.record(BleJournal::Connected, address);
+
+                  // a pooled link dropped by the peripheral is closed,
+                  // the next call opens a new one
+                  QObject::connect(controller,
+                                   &QLowEnergyController::disconnected,
+                                   peripheral,
+                                   [=]() {
+                                     if (!_linkPool.contains(handle)) {
+                                       return;
+                                     }
+                                     _trace.disconnected(address);
+                                     _journal.record(BleJournal::Disconnected,
+                                                     address);
+                                     // TODO i8n
+                                     closeLink(handle,
+                                               "Peripheral disconnected");
+                                   });
+
+                  peripheral->setReady(true);
+                  _scheduler.resume();
+                });
+
+  controller->connectToDevice();
+}
+
+/**
+ * @brief BleCentral::takePeripheral
+ *
+ * Takes a peripheral out of the table and fails its scheduled and queued
+ * operations with error, so none of them starts on it again. The caller
+ * deletes it, once the controller stopped emitting.
+ *
+ * @param handle
+ * @param error
+ * @return the peripheral, Q_NULLPTR if it was already taken
+ */
+BlePeripheral *BleCentral::takePeripheral(int handle, const QString& error) {
+  BlePeripheral *peripheral = _peripherals.take(handle);
+  if (peripheral) {
+    _scheduler.cancel(handle, error);
+    peripheral->cancelAll(error);
+  }
+  return peripheral;
+}
+
+/**
+ * @brief BleCentral::closeLink
+ *
+ * Removes a pooled peripheral whose link failed or dropped, failing its
+ * operations with error, and gives the slot to a waiting peripheral.
+ *
+ * @param handle
+ * @param error
+ */
+void BleCentral::closeLink(int handle, const QString& error) {
+  _linkPool.remove(handle);
+  // the controller may still be emitting
+  BlePeripheral *peripheral = takePeripheral(handle, error);
+  if (!peripheral) {
+    return;
+  }
+  peripheral->deleteLater();
+  pumpLinks();
+}
+
+/**
+ * @brief BleCentral::evict
+ *
+ * Disconnects an idle pooled peripheral. Its slot is given to a waiting
+ * peripheral once the link is down.
+ *
+ * @param handle
+ */
+void BleCentral::evict(int handle) {
+  _linkPool.remove(handle);
+  BlePeripheral *peripheral = _peripherals.take(handle);
+  const quint64 address = peripheral->address();
+  QLowEnergyController *controller = peripheral->controller();
+
+  _trace.disconnected(address);
+  _journal.record(BleJournal::Disconnected, address);
+
+  if (controller->state() == QLowEnergyController::UnconnectedState) {
+    peripheral->deleteLater();
+    return;
+  }
+
+  _linkPool.evictionStarted();
+  const BleConnectionPool::Group group = _connections.acquire(controller);
+  auto closed = [=]() {
+    group.release();
+    _linkPool.evictionFinished();
+    peripheral->deleteLater();
+    pumpLinks();
+  };
+
+  group.connect(controller, &QLowEnergyController::disconnected, closed);
+  void (QLowEnergyController::* controllerErrorMethodPtr)(
+        QLowEnergyController::Error)
+    = &QLowEnergyController::error;
+  group.connect(controller, controllerErrorMethodPtr, closed);
+
+  controller->disconnectFromDevice();
+}
+
+/**
+ * @brief BleCentral::sendValue
+ *
+ * Calls a callback with a value of the peripheral as a base64 string,
+ * formatted in the message buffer of the peripheral.
+ *
+ * @param cbId
+ * @param peripheral
+ * @param value
+ */
+void BleCentral::sendValue(int cbId, BlePeripheral *peripheral,
+                           const QByteArray& value) {
+  BleJsonWriter& writer = peripheral->messageWriter();
+  writer.reset();
+  writer.base64(value.constData(), value.size());
+  this->callback(cbId, writer.text());
+}
+
+/**
+ * @brief BleCentral::sendLink
+ *
+ * Calls a callback with the link state of the peripheral, formatted in
+ * its message buffer.
+ *
+ * @param cbId
+ * @param peripheral
+ * @param keepCallback whether the callback is called again later
+ */
+void BleCentral::sendLink(int cbId, BlePeripheral *peripheral,
+                          bool keepCallback) {
+  BleJsonWriter& writer = peripheral->messageWriter();
+  writer.reset();
+  writeLink(writer, peripheral->link());
+  if (keepCallback) {
+    this->callbackWithoutRemove(cbId, writer.text());
+  } else {
+    this->callback(cbId, writer.text());
+  }
+}
+
+/**
+ * @brief BleCentral::describePeripheral
+ *
+ * Discovers the details of every service of the peripheral, through its
+ * service cache, then calls done with the peripheral object including
+ * characteristic properties and descriptors.
+ *
+ * @param peripheral
+ * @param done
+ */
+void BleCentral::describePeripheral(
+    BlePeripheral *peripheral,
+    const std::function<void(const QVariantMap&)>& done) {
+  const QList<QBluetoothUuid> uuids = peripheral->controller()->services();
+  auto remaining = std::make_shared<int>(uuids.size());
+
+  auto serviceDone = [=]() {
+    if (--*remaining == 0) {
+      done(getConnectedDeviceInfos(peripheral));
+    }
+  };
+
+  if (uuids.isEmpty()) {
+    done(getConnectedDeviceInfos(peripheral));
+    return;
+  }
+
+  Q_FOREACH(const QBluetoothUuid& uuid, uuids) {
+    // services that fail to discover are reported without details
+    peripheral->withService(uuid,
+                            [=](QLowEnergyService *) { serviceDone(); },
+                            [=](const QString&) { serviceDone(); });
+  }
+}
+
+QVariantMap BleCentral::getConnectedDeviceInfos(BlePeripheral *peripheral) {
+  QLowEnergyController *controller = peripheral->controller();
+
   QVariantMap p;
-  p.insert("name", _connectedDevice->remoteName());
-  p.insert("id", _connectedDevice->remoteAddress().toString());
+  p.insert("name", controller->remoteName());
+  p.insert("id", controller->remoteAddress().toString());
+  p.insert("handle", peripheral->handle());
+  p.insert("link", linkToVariant(peripheral->link()));
 
   QVariantList services;
-  Q_FOREACH(QBluetoothUuid uuid, _connectedDevice->services()) {
+  Q_FOREACH(QBluetoothUuid uuid, controller->services()) {
     services.append(QString::number(uuid.toUInt16()));
   }
   p.insert("services", services);
 
   QVariantList characteristics;
-  Q_FOREACH(QBluetoothUuid uuid, _connectedDevice->services()) {
+  Q_FOREACH(QBluetoothUuid uuid, controller->services()) {
     QString serviceUuid = QString::number(uuid.toUInt16(), 16);
 
-    QLowEnergyService * service =
-      _connectedDevice->createServiceObject(uuid);
+    QLowEnergyService * service = peripheral->cachedService(uuid);
+    if (!service) {
+      continue;
+    }
 
     Q_FOREACH(QLowEnergyCharacteristic characteristic
               , service->characteristics()) {
@@ -165,13 +771,21 @@ QVariantMap BleCentral::getConnectedDeviceInfos() {
                    static_cast<QBluetoothUuid::CharacteristicType>(
                        characteristic.uuid().toUInt16())));
       c.insert("uuid", QString::number(characteristic.uuid().toUInt16()));
-
-      // TODO descriptor, properties
+      c.insert("properties", propertiesToVariant(characteristic.properties()));
+
+      QVariantList descriptors;
+      Q_FOREACH(QLowEnergyDescriptor descriptor
+                , characteristic.descriptors()) {
+        QVariantMap d;
+        d.insert("uuid", BleUuid::toString(descriptor.uuid()));
+        descriptors.append(QVariant(d));
+      }
+      if (!descriptors.isEmpty()) {
+        c.insert("descriptors", descriptors);
+      }
 
       characteristics.append(QVariant(c));
     }
-
-    delete service;
   }
   p.insert("characteristics", characteristics);
   return p;
@@ -179,72 +793,93 @@ QVariantMap BleCentral::getConnectedDeviceInfos() {
 
 void BleCentral::bleServiceError(QLowEnergyService::ServiceError error) {
   // TODO complete
-  qDebug() << error;
+  _journal.record(BleJournal::ServiceError, 0, QBluetoothUuid(), -1, error);
   //  this->cb(ecId, serviceErrorToString(error));
 }
 
-void BleCentral::startScanInternal(int scId, int ecId) {
+bool BleCentral::isScanning() const {
+  return (_discoveryAgent && _discoveryAgent->isActive()) || _replayScanning;
+}
+
+void BleCentral::startScanInternal(int scId, int ecId,
+                                   const QVariantMap& options) {
 
-  auto fc = std::make_shared<QMetaObject::Connection>();
-  auto cc = std::make_shared<QMetaObject::Connection>();
-  auto ddc = std::make_shared<QMetaObject::Connection>();
-  auto ec = std::make_shared<QMetaObject::Connection>();
+  _scanCallbackId = scId;
+  _scanResults.clear();
+  _journal.record(BleJournal::ScanStarted, 0);
+
+  const int batchInterval = options.value("batchInterval").toInt();
+  if (batchInterval > 0) {
+    _scanBatchTimer.start(batchInterval);
+  }
+
+  if (_replay) {
+    // scan results come from the replayed trace until stopScan; the
+    // devices it reported before, possibly before the scan could start,
+    // are found again like the cached devices of the radio
+    _replayScanning = true;
+    Q_FOREACH(const QBluetoothDeviceInfo& di, _replayDevices) {
+      deviceDiscovered(scId, di);
+    }
+    return;
+  }
 
-  *ddc =
-    QObject::connect(_discoveryAgent.data(),
-                     &QBluetoothDeviceDiscoveryAgent::deviceDiscovered,
-                     [=](const QBluetoothDeviceInfo& di){
-                       deviceDiscovered(scId, di);
-                     });
+  QBluetoothDeviceDiscoveryAgent *agent = discoveryAgent();
+  const BleConnectionPool::Group group = _connections.acquire(agent);
+
+  group.connect(agent,
+                &QBluetoothDeviceDiscoveryAgent::deviceDiscovered,
+                [=](const QBluetoothDeviceInfo& di){
+                  deviceDiscovered(scId, di);
+                });
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+  if (options.value("reportDuplicates").toBool()) {
+    group.connect(agent,
+                  &QBluetoothDeviceDiscoveryAgent::deviceUpdated,
+                  [=](const QBluetoothDeviceInfo& di,
+                      QBluetoothDeviceInfo::Fields) {
+                    deviceDiscovered(scId, di);
+                  });
+  }
+#endif
 #if 0
   void (QBluetoothDeviceDiscoveryAgent::* discoveryErrorMethodPtr)(
         QBluetoothServiceDiscoveryAgent::Error)
     = &QBluetoothDeviceDiscoveryAgent::error;
 
-  *ec =
-    QObject::connect(_discoveryAgent.data(),
-                     discoveryErrorMethodPtr,
-                     [=](QBluetoothDeviceDiscoveryAgent::Error e){
-                       deviceScanError(ecId, e);
-                       });
+  group.connect(agent,
+                discoveryErrorMethodPtr,
+                [=](QBluetoothDeviceDiscoveryAgent::Error e){
+                  deviceScanError(ecId, e);
+                  });
 #endif
   
-  *fc =
-    QObject::connect(_discoveryAgent.data(),
-                     &QBluetoothDeviceDiscoveryAgent::finished,
-                     [=]() {
-                       this->cb(scId, "ScanComplete");
-                       if (fc) {
-                         QObject::disconnect(*fc);
-                       }
-                       if (cc) {
-                         QObject::disconnect(*cc);
-                       }
-                       if (ddc) {
-                         QObject::disconnect(*ddc);
-                       }
-                       if (ec) {
-                         QObject::disconnect(*ec);
-                       }
-                     });
-  *cc =
-    QObject::connect(_discoveryAgent.data(),
-                     &QBluetoothDeviceDiscoveryAgent::canceled,
-                     [=]() {
-                       this->cb(ecId, "ScanCancelled");
-                       if (fc) {
-                         QObject::disconnect(*fc);
-                       }
-                       if (cc) {
-                         QObject::disconnect(*cc);
-                       }
-                       if (ddc) {
-                         QObject::disconnect(*ddc);
-                       }
-                       if (ec) {
-                         QObject::disconnect(*ec);
-                       }
-                     });
+  group.connect(agent,
+                &QBluetoothDeviceDiscoveryAgent::finished,
+                [=]() {
+                  group.release();
+
+                  _journal.record(BleJournal::ScanStopped, 0);
+                  _presence.clear();
+                  _scanBatchTimer.stop();
+                  flushScanResults();
+
+                  this->cb(scId, "ScanComplete");
+                });
+  group.connect(agent,
+                &QBluetoothDeviceDiscoveryAgent::canceled,
+                [=]() {
+                  group.release();
+
+                  _journal.record(BleJournal::ScanStopped, 0);
+                  _presence.clear();
+                  _scanBatchTimer.stop();
+                  flushScanResults();
+
+                  this->cb(ecId, "ScanCancelled");
+                });
+
+  agent->start();
 }
 
 /**
@@ -264,18 +899,24 @@ void BleCentral::scan(int scId,
                       const QVariantList& services,
                       int seconds) {
   // TODO complete
-  Q_UNUSED(services);
   Q_UNUSED(seconds);
 
-  if (_discoveryAgent->isActive()) {
+  if (isScanning()) {
     // TODO i8n
     this->cb(ecId, "Already scanning");
     return;
   }
 
-  startScanInternal(scId, ecId);
+  QString error;
+  if (!_scanFilter.compile(btUuidsFromVariantList(services),
+                           QVariantList(), &error)) {
+    this->cb(ecId, error);
+    return;
+  }
+  // plain scans report every advertisement
+  _presence.configure(QVariantMap(), &error);
 
-  _discoveryAgent->start();
+  startScanInternal(scId, ecId, QVariantMap());
 }
 
 /**
@@ -291,17 +932,22 @@ void BleCentral::scan(int scId,
  */
 void BleCentral::startScan(int scId, int ecId,
                            const QVariantList& services) {
-  Q_UNUSED(services);
-
-  if (_discoveryAgent->isActive()) {
+  if (isScanning()) {
     // TODO i8n
     this->cb(ecId, "Already scanning");
     return;
   }
 
-  startScanInternal(scId, ecId);
+  QString error;
+  if (!_scanFilter.compile(btUuidsFromVariantList(services),
+                           QVariantList(), &error)) {
+    this->cb(ecId, error);
+    return;
+  }
+  // plain scans report every advertisement
+  _presence.configure(QVariantMap(), &error);
 
-  _discoveryAgent->start();
+  startScanInternal(scId, ecId, QVariantMap());
 }
 
 /**
@@ -319,22 +965,39 @@ void BleCentral::startScan(int scId, int ecId,
  * @param options an object specifying a set of name-value pairs. The currently acceptable options are:
                     reportDuplicates: true if duplicate devices should be reported,
                                       false (default) if devices should only be reported once. [optional]
+                    filters: list of advertisement content filters, see
+                             BleScanFilter::compile(). A device is reported
+                             when any of them matches. [optional]
+                    batchInterval: if set, scan results are collected
+                                   and reported as an array every
+                                   batchInterval milliseconds, with the
+                                   latest state of each device. [optional]
+                    presence: if set, the callback is called with enter,
+                              exit and zone change events instead of
+                              scan results, see BlePresence::configure().
+                              batchInterval does not apply. [optional]
  */
 void BleCentral::startScanWithOptions(int scId, int ecId,
                                       const QVariantList& services,
                                       const QVariantMap& options) {
-  Q_UNUSED(services);
-  Q_UNUSED(options);
-
-  if (_discoveryAgent->isActive()) {
+  if (isScanning()) {
     // TODO i8n
     this->cb(ecId, "Already scanning");
     return;
   }
 
-  startScanInternal(scId, ecId);
+  QString error;
+  if (!_scanFilter.compile(btUuidsFromVariantList(services),
+                           options.value("filters").toList(), &error)) {
+    this->cb(ecId, error);
+    return;
+  }
+  if (!_presence.configure(options.value("presence").toMap(), &error)) {
+    this->cb(ecId, error);
+    return;
+  }
 
-  _discoveryAgent->start();
+  startScanInternal(scId, ecId, options);
 }
 
 /**
@@ -346,22 +1009,32 @@ void BleCentral::startScanWithOptions(int scId, int ecId,
  * @param ecId
  */
 void BleCentral::stopScan(int scId, int ecId) {
-  if (!_discoveryAgent->isActive()) {
+  if (!isScanning()) {
     // TODO i8n
     this->cb(ecId, "No Scan is running");
     return;
   }
 
-  auto cc = std::make_shared<QMetaObject::Connection>();
-  *cc =
-    QObject::connect(_discoveryAgent.data(),
-                     &QBluetoothDeviceDiscoveryAgent::canceled,
-                     [=]() {
-                       this->cb(scId, "ScanCanceled");
-                       QObject::disconnect(*cc);
-                     });
+  if (_replayScanning) {
+    _journal.record(BleJournal::ScanStopped, 0);
+    _presence.clear();
+    _replayScanning = false;
+    _scanBatchTimer.stop();
+    flushScanResults();
+    this->cb(scId, "ScanCanceled");
+    return;
+  }
+
+  QBluetoothDeviceDiscoveryAgent *agent = discoveryAgent();
+  const BleConnectionPool::Group group = _connections.acquire(agent);
+  group.connect(agent,
+                &QBluetoothDeviceDiscoveryAgent::canceled,
+                [=]() {
+                  group.release();
+                  this->cb(scId, "ScanCanceled");
+                });
 
-  _discoveryAgent->stop();
+  agent->stop();
 }
 
 /**
@@ -371,77 +1044,147 @@ void BleCentral::stopScan(int scId, int ecId) {
  * The callback is long running.
  * Success will be called when the connection is successful.
  * Service and characteristic info will be passed to the success callback in
- * the peripheral object.
+ * the peripheral object, with the handle the other calls accept in place
+ * of the address.
  * Failure is called if the connection fails, or later if the peripheral
  * disconnects.
  * An peripheral object is passed to the failure callback
  *
  * @param scId
  * @param ecId
- * @param deviceId UUID or MAC address of the peripheral
+ * @param deviceId MAC address of the peripheral
  */
 void BleCentral::connect(int scId, int ecId
                          , const QString& deviceId) {
-  if (_connectedDevice) {
+  const quint64 deviceAddress = BlePeripheralTable::parseAddress(deviceId);
+  BlePeripheral *pooled = _peripherals.findAddress(deviceAddress);
+  if (pooled && _linkPool.contains(pooled->handle()) && pooled->isReady()) {
+    // the pooled link becomes a connection of its own, never evicted, and
+    // the services discovered through it are reused
+    _linkPool.remove(pooled->handle());
+    describePeripheral(pooled, [=](const QVariantMap& info) {
+        const QString description =
+          QString::fromUtf8(QJsonDocument::fromVariant(info).toJson());
+        _linkPool.cache(deviceAddress, description);
+        this->cb(scId, description);
+      });
+    return;
+  }
+  if (pooled) {
     // TODO i8n
     this->cb(ecId,
             QString("Already connected to device %1")
-              .arg(_connectedDevice->remoteAddress().toString()));
+              .arg(deviceId));
+    return;
+  }
+  if (_peripherals.size() == BlePeripheralTable::Capacity) {
+    // TODO i8n
+    this->cb(ecId, "Too many connected devices");
+    return;
+  }
+
+  _journal.record(BleJournal::ConnectRequested, deviceAddress);
+
+  if (_replay) {
+    connectSimulated(scId, ecId, deviceId);
     return;
   }
 
-  Q_FOREACH(QBluetoothDeviceInfo di, _discoveryAgent->discoveredDevices()) {
+  // nothing was discovered if no scan ever built the agent
+  const QList<QBluetoothDeviceInfo> discovered = _discoveryAgent
+    ? _discoveryAgent->discoveredDevices() : QList<QBluetoothDeviceInfo>();
+  Q_FOREACH(QBluetoothDeviceInfo di, discovered) {
     if ( ! isBleDevice(di.coreConfigurations())) {
       continue;
     }
-    if (di.address().toString() == deviceId) {
-      _connectedDevice.reset(new QLowEnergyController(di.address(), this));
-
-      auto ctdc = std::make_shared<QMetaObject::Connection>();
-      auto dfc = std::make_shared<QMetaObject::Connection>();
-      auto ec = std::make_shared<QMetaObject::Connection>();
-
-      *ctdc =
-        QObject::connect(_connectedDevice.data(),
-                         &QLowEnergyController::connected,
-                         [=]() {
-                           QObject::disconnect(*ctdc);
-                           this->_connectedDevice->discoverServices();
-                         });
+    if (di.address().toUInt64() == deviceAddress) {
+      BlePeripheral *peripheral = new BlePeripheral(di.address(), this);
+      const BlePeripheralTable::Handle handle = _peripherals.insert(peripheral);
+      configurePeripheral(peripheral);
+
+      QLowEnergyController *controller = peripheral->controller();
+      const quint64 address = di.address().toUInt64();
+      const qint64 started = _trace.now();
+
+      // released once connected, on error and on timeout
+      const BleConnectionPool::Group group = _connections.acquire(controller);
+
+      const BleTimerWheel::Handle timeout = _connectTimeout <= 0 ? 0 :
+        _timers.schedule(_connectTimeout, [=]() {
+            group.release();
+
+            // TODO i8n
+            const QString error = QLatin1String("Connection timed out");
+            if (_peripherals.find(handle) == peripheral) {
+              _trace.connectFailed(address, started, error);
+              _peripherals.take(handle)->deleteLater();
+            }
+            this->cb(ecId, error);
+          });
+
+      group.connect(controller,
+                    &QLowEnergyController::connected,
+                    [=]() {
+                      controller->discoverServices();
+                    });
 
       void (QLowEnergyController::* serviceErrorMethodPtr)(QLowEnergyController::Error)
         = &QLowEnergyController::error;
-      *ec =
-        QObject::connect(_connectedDevice.data(),
-                         serviceErrorMethodPtr,
-                         [=]() {
-                           QObject::disconnect(*ctdc);
-                           QObject::disconnect(*ctdc);
-                           QObject::disconnect(*ec);
-
-			   this->cb(ecId,
-				    QString("Error: %1").arg(
-     			                _connectedDevice->errorString()));
-                         });
-
-      *dfc =
-        QObject::connect(_connectedDevice.data(),
-                         &QLowEnergyController::discoveryFinished,
-                         [=]() {
-                           QObject::disconnect(*dfc);
-                           QObject::disconnect(*ctdc);
-                           QObject::disconnect(*ec);
-			   
-                           QVariantMap info =
-                             getConnectedDeviceInfos();
-
-                           this->cb(scId,
-                                    QString::fromUtf8(
-                                        QJsonDocument::fromVariant(
-                                            info).toJson()));
-                         });
-
-      _connectedDevice->connectToDevice();
+      group.connect(controller,
+                    serviceErrorMethodPtr,
+                    [=]() {
+                      group.release();
+                      _timers.cancel(timeout);
+
+                      const QString error =
+                        QString("Error: %1").arg(
+                            controller->errorString());
+                      _trace.connectFailed(address, started, error);
+                      // the controller is still emitting
+                      if (BlePeripheral *failed = _peripherals.take(handle)) {
+                        failed->deleteLater();
+                      }
+                      this->cb(ecId, error);
+                    });
+
+      group.connect(controller,
+                    &QLowEnergyController::discoveryFinished,
+                    [=]() {
+                      group.release();
+
+                      const QString cached = _linkPool.isEnabled()
+                        ? _linkPool.cached(address) : QString();
+                      if (!cached.isEmpty()) {
+                        // a reconnection, the service details are
+                        // discovered again on first use
+                        _timers.cancel(timeout);
+                        _trace.connected(address, started, cached);
+                        _journal.record(BleJournal::Connected, address);
+                        this->cb(scId, reconnected(cached, peripheral));
+                        return;
+                      }
+
+                      describePeripheral(
+                          peripheral,
+                          [=](const QVariantMap& info) {
+                            _timers.cancel(timeout);
+
+                            const QString description =
+                              QString::fromUtf8(
+                                  QJsonDocument::fromVariant(
+                                      info).toJson());
+                            _trace.connected(address, started,
+                                             description);
+                            _journal.record(BleJournal::Connected,
+                                            address);
+                            if (_linkPool.isEnabled()) {
+                              _linkPool.cache(address, description);
+                            }
+                            this->cb(scId, description);
+                          });
+                    });
+
+      controller->connectToDevice();
 
       break;
     }
@@ -449,64 +1192,153 @@ void BleCentral::connect(int scId, int ecId
 }
 
 /**
- * @brief BleCentral::disconnectFromDevice
+ * @brief BleCentral::configurePeripheral
  *
- * Function disconnect disconnects the selected device
+ * Hands the shared plugin facilities and the configured timeouts to a new
+ * peripheral.
+ *
+ * @param peripheral
+ */
+void BleCentral::configurePeripheral(BlePeripheral *peripheral) {
+  peripheral->setTimerWheel(&_timers);
+  peripheral->setJournal(&_journal);
+  peripheral->setRecorder(&_recorder);
+  peripheral->setTrace(&_trace);
+  // notifications are switched on and off between jobs, never in the
+  // middle of a batch or a transaction
+  peripheral->setSubmitter([this, peripheral](
+      const BlePeripheral::Operation& operation) {
+      _scheduler.submit(peripheral, BleScheduler::Control, operation);
+    });
+  applyTimeouts(peripheral);
+}
+
+void BleCentral::applyTimeouts(BlePeripheral *peripheral) {
+  peripheral->setTimeout(BlePeripheral::ReadCharacteristic, _readTimeout);
+  peripheral->setTimeout(BlePeripheral::WriteCharacteristic, _writeTimeout);
+  peripheral->setTimeout(BlePeripheral::WriteCharacteristicWithoutResponse,
+                         _writeTimeout);
+  peripheral->setTimeout(BlePeripheral::ReadDescriptor, _descriptorTimeout);
+  peripheral->setTimeout(BlePeripheral::WriteDescriptor, _descriptorTimeout);
+}
+
+/**
+ * @brief BleCentral::connectSimulated
+ *
+ * Connects to a peripheral of the replayed trace, with the outcome and
+ * duration of a recorded connection to it.
  *
  * @param scId
  * @param ecId
- * @param deviceId UUID or MAC address of the peripheral
+ * @param deviceId MAC address of the peripheral
  */
-void BleCentral::disconnect(int scId, int ecId
-                            , const QString& deviceId) {
-  if (! _connectedDevice) {
-    // TODO i8n
-    this->cb(ecId,
-             QString("Not connected to device %1")
-               .arg(deviceId));
-    return;
-  }
+void BleCentral::connectSimulated(int scId, int ecId
+                                  , const QString& deviceId) {
+  const QBluetoothAddress btAddress(deviceId);
+  const quint64 address = btAddress.toUInt64();
 
-  if (_connectedDevice->remoteAddress().toString() != deviceId) {
+  const BleTrace::Event *event = _replay->connection(address);
+  if (!event) {
     // TODO i8n
-    this->cb(ecId,
-             QString("Not connected to device %1 but to device %2")
-               .arg(deviceId)
-               .arg(_connectedDevice->remoteAddress().toString()));
+    this->cb(ecId, QString("Device %1 not in trace").arg(deviceId));
     return;
   }
 
-  auto dc = std::make_shared<QMetaObject::Connection>();
-  auto ec = std::make_shared<QMetaObject::Connection>();
+  BlePeripheral *peripheral = new BlePeripheral(btAddress, this);
+  const BlePeripheralTable::Handle handle = _peripherals.insert(peripheral);
+  configurePeripheral(peripheral);
+  peripheral->setReplay(_replay.data());
+
+  const qint64 started = _trace.now();
+  const bool ok = event->ok;
+  const QString text = event->text;
+  QTimer::singleShot(_replay->delay(event->duration), peripheral, [=]() {
+      if (ok) {
+        _trace.connected(address, started, text);
+        _journal.record(BleJournal::Connected, address);
+        this->cb(scId, reconnected(text, peripheral));
+      } else {
+        _trace.connectFailed(address, started, text);
+        _peripherals.take(handle)->deleteLater();
+        this->cb(ecId, text);
+      }
+    });
+}
+
+/**
+ * @brief BleCentral::disconnectFromDevice
+ *
+ * Function disconnect disconnects the selected device
+ *
+ * @param scId
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ */
+void BleCentral::disconnect(int scId, int ecId
+                            , const QString& deviceId) {
+  BlePeripheral *peripheral = peripheralFor(ecId, deviceId);
+  if (!peripheral) {
+    return;
+  }
+
+  const quint64 address = peripheral->address();
+  const BlePeripheralTable::Handle handle = peripheral->handle();
+  if (_linkPool.contains(handle)) {
+    _linkPool.remove(handle);
+    if (!peripheral->isReady()) {
+      // still waiting for a pooled link or opening it
+      // TODO i8n
+      closeLink(handle, "Peripheral disconnected");
+      this->cb(scId, "Disconnected");
+      return;
+    }
+  }
+  if (peripheral->isSimulated()) {
+    _trace.disconnected(address);
+    _journal.record(BleJournal::Disconnected, address);
+    // TODO i8n
+    takePeripheral(handle, "Peripheral disconnected")->deleteLater();
+    this->cb(scId, "Disconnected");
+    return;
+  }
+
+  QLowEnergyController *controller = peripheral->controller();
+
+  const BleConnectionPool::Group group = _connections.acquire(controller);
 
-  *dc =
-    QObject::connect(_connectedDevice.data(),
-                     &QLowEnergyController::disconnected,
-                     [=]() {
-                       QObject::disconnect(*dc);
-                       QObject::disconnect(*ec);
+  group.connect(controller,
+                &QLowEnergyController::disconnected,
+                [=]() {
+                  group.release();
 
-                       this->_connectedDevice.reset();
+                  _trace.disconnected(address);
+                  _journal.record(BleJournal::Disconnected, address);
 
-                       this->cb(scId, "Disconnected");
-                     });
+                  // the controller is still emitting
+                  // TODO i8n
+                  if (BlePeripheral *disconnected =
+                      takePeripheral(handle, "Peripheral disconnected")) {
+                    disconnected->deleteLater();
+                  }
+
+                  this->cb(scId, "Disconnected");
+                  pumpLinks();
+                });
 
   void (QLowEnergyController::* controllerErrorMethodPtr)(
         QLowEnergyController::Error)
     = &QLowEnergyController::error;
-  *ec =
-    QObject::connect(_connectedDevice.data(),
-		     controllerErrorMethodPtr,
-		     [=]() {
-		       QObject::disconnect(*dc);
-		       QObject::disconnect(*ec);
-
-		       this->cb(ecId,
-				QString("Error: %1").arg(
-				    _connectedDevice->errorString()));
-		     });
-  
-  _connectedDevice->disconnectFromDevice();
+  group.connect(controller,
+                controllerErrorMethodPtr,
+                [=]() {
+                  group.release();
+
+                  this->cb(ecId,
+                           QString("Error: %1").arg(
+                               controller->errorString()));
+                });
+
+  controller->disconnectFromDevice();
 }
 
 /**
@@ -516,7 +1348,7 @@ void BleCentral::disconnect(int scId, int ecId
  *
  * @param scId
  * @param ecId
- * @param deviceId UUID or MAC address of the peripheral
+ * @param deviceId handle or MAC address of the peripheral
  * @param serviceUuid UUID of the BLE service
  * @param characteristicUuid UUID of the BLE characteristic
  */
@@ -524,67 +1356,58 @@ void BleCentral::read(int scId, int ecId
                       , const QString& deviceId
                       , const QString& serviceUuid
                       , const QString& characteristicUuid) {
-  if (!_connectedDevice) {
-    this->cb(ecId,
-            QString("Not connected to device %1")
-              .arg(deviceId));
-    return;
-  }
+  readInternal(scId, ecId, deviceId, serviceUuid, characteristicUuid,
+               BleScheduler::Interactive);
+}
 
-  if (_connectedDevice->remoteAddress().toString() != deviceId) {
-    // TODO i8n
-    this->cb(ecId,
-            QString("Not connected to device %1 but to device %2")
-              .arg(deviceId)
-              .arg(_connectedDevice->remoteAddress().toString()));
+/**
+ * @brief BleCentral::readWithOptions
+ *
+ * Function readWithOptions reads the value of the characteristic, in the
+ * priority class given by the options.
+ *
+ * @param scId
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @param serviceUuid UUID of the BLE service
+ * @param characteristicUuid UUID of the BLE characteristic
+ * @param options priority: "control", "interactive" (default) or "bulk"
+ */
+void BleCentral::readWithOptions(int scId, int ecId
+                                 , const QString& deviceId
+                                 , const QString& serviceUuid
+                                 , const QString& characteristicUuid
+                                 , const QVariantMap& options) {
+  BleScheduler::Priority priority;
+  if (!priorityFor(ecId, options, &priority)) {
     return;
   }
+  readInternal(scId, ecId, deviceId, serviceUuid, characteristicUuid,
+               priority);
+}
 
-  QBluetoothUuid btServiceUuid (
-      btUuidFromUuidString(serviceUuid));
-
-  QLowEnergyService * service =
-    _connectedDevice->createServiceObject(btServiceUuid);
-  if (!service) {
-      // TODO i8n
-    this->cb(ecId,
-	     QLatin1String("Could not create low energy service object"));
+void BleCentral::readInternal(int scId, int ecId
+                              , const QString& deviceId
+                              , const QString& serviceUuid
+                              , const QString& characteristicUuid
+                              , BleScheduler::Priority priority) {
+  BlePeripheral *peripheral = linkFor(ecId, deviceId);
+  if (!peripheral) {
     return;
   }
 
-  QBluetoothUuid btCharUuid (
-      btUuidFromUuidString(characteristicUuid));
-
-  auto continuation = [=]() {
-    QLowEnergyCharacteristic characteristic =
-      service->characteristic(btCharUuid);
-
-    qDebug() << "BleCentral::read: "
-      << characteristic.uuid()
-      << characteristic.value().toBase64();
-
-    this->cb(scId,
-             QString::fromUtf8(characteristic.value().toBase64()));
-
-    delete service;
+  BlePeripheral::Operation operation;
+  operation.type = BlePeripheral::ReadCharacteristic;
+  operation.service = btUuidFromUuidString(serviceUuid);
+  operation.characteristic = btUuidFromUuidString(characteristicUuid);
+  operation.success = [=](const QByteArray& value) {
+    sendValue(scId, peripheral, value);
+  };
+  operation.failure = [=](const QString& error) {
+    this->cb(ecId, error);
   };
 
-  if (service->state() == QLowEnergyService::DiscoveryRequired) {
-    QObject::connect(service,
-                     &QLowEnergyService::stateChanged,
-                     [=](QLowEnergyService::ServiceState ns) {
-                       if (ns == QLowEnergyService::ServiceDiscovered) {
-                         continuation();
-                       }
-                     });
-    service->discoverDetails();
-    return;
-  } else if (service->state() != QLowEnergyService::ServiceDiscovered) {
-    this->cb(ecId,
-	     QLatin1String("Device not connected or closing"));
-    return;
-  }
-  continuation();
+  _scheduler.submit(peripheral, priority, operation);
 }
 
 /**
@@ -594,7 +1417,7 @@ void BleCentral::read(int scId, int ecId
  *
  * @param scId
  * @param ecId
- * @param deviceId UUID or MAC address of the peripheral
+ * @param deviceId handle or MAC address of the peripheral
  * @param serviceUuid UUID of the BLE service
  * @param characteristicUuid UUID of the BLE characteristic
  * @param binaryData binary data
@@ -604,100 +1427,8 @@ void BleCentral::write(int scId, int ecId
                        , const QString& serviceUuid
                        , const QString& characteristicUuid
                        , const QString& binaryData) {
-  if (!_connectedDevice) {
-    this->cb(ecId,
-            QString("Not connected to device %1")
-              .arg(deviceId));
-    return;
-  }
-
-  if (_connectedDevice->remoteAddress().toString() != deviceId) {
-    // TODO i8n
-    this->cb(ecId,
-            QString("Not connected to device %1 but to device %2")
-              .arg(deviceId)
-              .arg(_connectedDevice->remoteAddress().toString()));
-    return;
-  }
-
-  // TODO no simultaneous writes()
-
-  QBluetoothUuid btServiceUuid (
-      btUuidFromUuidString(serviceUuid));
-
-  QLowEnergyService * service =
-    _connectedDevice->createServiceObject(btServiceUuid);
-  if (!service) {
-      // TODO i8n
-    this->cb(ecId,
-	     QLatin1String("Could not create low energy service object"));
-    return;
-  }
-
-  auto continuation = [=]() {
-    auto cwc = std::make_shared<QMetaObject::Connection>();
-    auto sec = std::make_shared<QMetaObject::Connection>();
-
-    *cwc =
-      QObject::connect(service,
-                       &QLowEnergyService::characteristicWritten,
-                       [=](const QLowEnergyCharacteristic& c,
-                           const QByteArray&) {
-                         this->cb(scId, QLatin1String("CharacteristicWritten"));
-                         
-                         qDebug() << "BleCentral::write: CharacteristicWritten"
-			          << c.uuid();
-
-			 QObject::disconnect(*cwc);
-			 QObject::disconnect(*sec);
-                       });
-
-    void (QLowEnergyService::* serviceErrorMethodPtr)(QLowEnergyService::ServiceError)
-      = &QLowEnergyService::error;
-    *sec =
-      QObject::connect(service,
-                       serviceErrorMethodPtr,
-		       [=](QLowEnergyService::ServiceError error) {
-			 this->cb(ecId, _connectedDevice->errorString());
-
-			 QObject::disconnect(*cwc);
-			 QObject::disconnect(*sec);
-		       });
-
-    QBluetoothUuid btCharUuid(btUuidFromUuidString(characteristicUuid));
-
-    QLowEnergyCharacteristic characteristic =
-        service->characteristic(btCharUuid);
-
-    if (!characteristic.properties().testFlag(QLowEnergyCharacteristic::Write)) {
-      this->cb(ecId, QLatin1String("Characteristic not writable"));
-      return;
-    }
-
-    qDebug() << "BleCentral::write:"
-             << QByteArray::fromBase64(binaryData.toUtf8());
-
-    service->writeCharacteristic(characteristic,
-                                 QByteArray::fromBase64(binaryData.toUtf8()));
-  };
-
-  if (service->state() == QLowEnergyService::DiscoveryRequired) {
-    QObject::connect(service,
-                     &QLowEnergyService::stateChanged,
-                     [=](QLowEnergyService::ServiceState ns) {
-                       if (ns == QLowEnergyService::ServiceDiscovered) {
-                         continuation();
-                       }
-                     });
-    service->discoverDetails();
-    return;
-  } else if (service->state() != QLowEnergyService::ServiceDiscovered) {
-    this->cb(ecId,
-	     QLatin1String("Device not connected or closing"));
-    return;
-  }
-
-  continuation();
+  writeInternal(scId, ecId, deviceId, serviceUuid, characteristicUuid,
+                binaryData, false, false, BleScheduler::Interactive);
 }
 
 /**
@@ -710,7 +1441,7 @@ void BleCentral::write(int scId, int ecId
  *
  * @param scId
  * @param ecId
- * @param deviceId UUID or MAC address of the peripheral
+ * @param deviceId handle or MAC address of the peripheral
  * @param serviceUuid UUID of the BLE service
  * @param characteristicUuid UUID of the BLE characteristic
  * @param binaryData binary data
@@ -720,284 +1451,1594 @@ void BleCentral::writeWithoutResponse(int scId, int ecId
                                       , const QString& serviceUuid
                                       , const QString& characteristicUuid
                                       , const QString& binaryData) {
-  if (!_connectedDevice) {
-    this->cb(ecId,
-            QString("Not connected to device %1")
-              .arg(deviceId));
-    return;
-  }
+  writeInternal(scId, ecId, deviceId, serviceUuid, characteristicUuid,
+                binaryData, true, false, BleScheduler::Interactive);
+}
 
-  if (_connectedDevice->remoteAddress().toString() != deviceId) {
-    // TODO i8n
-    this->cb(ecId,
-            QString("Not connected to device %1 but to device %2")
-              .arg(deviceId)
-              .arg(_connectedDevice->remoteAddress().toString()));
+/**
+ * @brief BleCentral::writeWithOptions
+ *
+ * Function writeWithOptions writes data to a characteristic, in the
+ * priority class given by the options.
+ *
+ * @param scId
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @param serviceUuid UUID of the BLE service
+ * @param characteristicUuid UUID of the BLE characteristic
+ * @param binaryData binary data
+ * @param options priority: "control", "interactive" (default) or "bulk",
+ *        withoutResponse: true to write without response,
+ *        split: true to send a value longer than the MTU allows as
+ *        consecutive writes without response
+ */
+void BleCentral::writeWithOptions(int scId, int ecId
+                                  , const QString& deviceId
+                                  , const QString& serviceUuid
+                                  , const QString& characteristicUuid
+                                  , const QString& binaryData
+                                  , const QVariantMap& options) {
+  BleScheduler::Priority priority;
+  if (!priorityFor(ecId, options, &priority)) {
     return;
   }
+  writeInternal(scId, ecId, deviceId, serviceUuid, characteristicUuid,
+                binaryData, options.value("withoutResponse").toBool(),
+                options.value("split").toBool(), priority);
+}
 
-  QBluetoothUuid btServiceUuid (
-      btUuidFromUuidString(serviceUuid));
-
-  QLowEnergyService * service =
-    _connectedDevice->createServiceObject(btServiceUuid);
-  if (!service) {
-      // TODO i8n
-    this->cb(ecId,
-	     QLatin1String("Could not create low energy service object"));
+void BleCentral::writeInternal(int scId, int ecId
+                               , const QString& deviceId
+                               , const QString& serviceUuid
+                               , const QString& characteristicUuid
+                               , const QString& binaryData
+                               , bool withoutResponse
+                               , bool split
+                               , BleScheduler::Priority priority) {
+  BlePeripheral *peripheral = linkFor(ecId, deviceId);
+  if (!peripheral) {
     return;
   }
 
-  auto continuation = [=]() {
-    QBluetoothUuid btCharUuid (
-        btUuidFromUuidString(characteristicUuid));
-    
-    QLowEnergyCharacteristic characteristic =
-      service->characteristic(btCharUuid);
-
-    service->writeCharacteristic(characteristic,
-				 QByteArray::fromBase64(binaryData.toUtf8()),
-				 QLowEnergyService::WriteWithoutResponse);
+  BlePeripheral::Operation operation;
+  operation.type = withoutResponse
+    ? BlePeripheral::WriteCharacteristicWithoutResponse
+    : BlePeripheral::WriteCharacteristic;
+  operation.service = btUuidFromUuidString(serviceUuid);
+  operation.characteristic = btUuidFromUuidString(characteristicUuid);
+  operation.value = QByteArray::fromBase64(binaryData.toUtf8());
+  operation.split = split;
+  operation.success = [=](const QByteArray&) {
+    this->cb(scId, QLatin1String("CharacteristicWritten"));
+  };
+  operation.failure = [=](const QString& error) {
+    this->cb(ecId, error);
   };
 
-  if (service->state() == QLowEnergyService::DiscoveryRequired) {
-    QObject::connect(service,
-                     &QLowEnergyService::stateChanged,
-                     [=](QLowEnergyService::ServiceState ns) {
-                       if (ns == QLowEnergyService::ServiceDiscovered) {
-                         continuation();
-                       }
-                     });
-    service->discoverDetails();
-    return;
-  } else if (service->state() != QLowEnergyService::ServiceDiscovered) {
-    this->cb(ecId,
-	     QLatin1String("Device not connected or closing"));
-    return;
-  }
+  _scheduler.submit(peripheral, priority, operation);
+}
 
-  continuation();
+/**
+ * @brief BleCentral::priorityFor
+ *
+ * Reads the priority class of a GATT call from its options, calling the
+ * error callback if it is not known.
+ *
+ * @param ecId
+ * @param options
+ * @param priority set to the class, interactive if not given
+ * @return false if the class is not known
+ */
+bool BleCentral::priorityFor(int ecId, const QVariantMap& options,
+                             BleScheduler::Priority *priority) {
+  *priority = BleScheduler::Interactive;
+  const QString name = options.value("priority").toString();
+  if (!name.isEmpty() && !BleScheduler::fromName(name, priority)) {
+    // TODO i8n
+    this->cb(ecId, QString("Unknown priority %1").arg(name));
+    return false;
+  }
+  return true;
 }
 
 /**
- * @brief BleCentral::startNotification
+ * @brief BleCentral::readDescriptor
  *
- * Function startNotification registers a callback that is called every
- * time the value of a characteristic changes.
- * This method handles both notifications and indications.
- * The success callback is called multiple times
+ * Function readDescriptor reads the value of a descriptor.
+ * The success callback is called with the value as an ArrayBuffer.
  *
  * @param scId
  * @param ecId
- * @param deviceId UUID or MAC address of the peripheral
+ * @param deviceId handle or MAC address of the peripheral
  * @param serviceUuid UUID of the BLE service
  * @param characteristicUuid UUID of the BLE characteristic
+ * @param descriptorUuid UUID of the descriptor
  */
-void BleCentral::startNotification(int scId, int ecId
-                                   , const QString& deviceId
-                                   , const QString& serviceUuid
-                                   , const QString& characteristicUuid) {
-  if (!_connectedDevice) {
-    this->cb(ecId,
-             QString("Not connected to device %1")
-               .arg(deviceId));
-    return;
-  }
-
-  if (_connectedDevice->remoteAddress().toString() != deviceId) {
-    // TODO i8n
-    this->cb(ecId,
-             QString("Not connected to device %1 but to device %2")
-               .arg(deviceId)
-               .arg(_connectedDevice->remoteAddress().toString()));
-    return;
-  }
-
-  QBluetoothUuid btServiceUuid (
-      btUuidFromUuidString(serviceUuid));
-
-  QLowEnergyService * service =
-    _connectedDevice->createServiceObject(btServiceUuid);
-  if (!service) {
-    // TODO i8n
-    this->cb(ecId,
-             QStringLiteral("Could not create low energy service object for service id {}")
-  	       .arg(serviceUuid));
+void BleCentral::readDescriptor(int scId, int ecId
+                                , const QString& deviceId
+                                , const QString& serviceUuid
+                                , const QString& characteristicUuid
+                                , const QString& descriptorUuid) {
+  BlePeripheral *peripheral = linkFor(ecId, deviceId);
+  if (!peripheral) {
     return;
   }
 
-  auto continuation = [=]() {
-    QObject::connect(service,
-                     &QLowEnergyService::characteristicChanged,
-                     [=](const QLowEnergyCharacteristic& c,
-                         const QByteArray& data) {
-
-                       quint16 id = characteristicUuid.toUShort(Q_NULLPTR, 16);
-
-                       if (id == c.uuid().toUInt16()) {
-                         this->cb(scId,
-                                  QString::fromUtf8(data.toBase64()));
-                       }
-                   });
+  BlePeripheral::Operation operation;
+  operation.type = BlePeripheral::ReadDescriptor;
+  operation.service = btUuidFromUuidString(serviceUuid);
+  operation.characteristic = btUuidFromUuidString(characteristicUuid);
+  operation.descriptor = btUuidFromUuidString(descriptorUuid);
+  operation.success = [=](const QByteArray& value) {
+    BleJsonWriter& writer = peripheral->messageWriter();
+    writer.reset();
+    writer.arrayBuffer(value.constData(), value.size());
+    this->callback(scId, writer.text());
+  };
+  operation.failure = [=](const QString& error) {
+    this->cb(ecId, error);
   };
 
-  if (service->state() == QLowEnergyService::DiscoveryRequired) {
-    QObject::connect(service,
-                     &QLowEnergyService::stateChanged,
-                     [=](QLowEnergyService::ServiceState ns) {
-                       if (ns == QLowEnergyService::ServiceDiscovered) {
-                         continuation();
-                       }
-                     });
-    service->discoverDetails();
-    return;
-  }
-  continuation();
+  _scheduler.submit(peripheral, BleScheduler::Interactive, operation);
 }
 
 /**
- * @brief BleCentral::stopNotification
+ * @brief BleCentral::writeDescriptor
  *
- * Function stopNotification stops a previously registered notification callback
+ * Function writeDescriptor writes data to a descriptor
  *
  * @param scId
  * @param ecId
- * @param deviceId UUID or MAC address of the peripheral
+ * @param deviceId handle or MAC address of the peripheral
  * @param serviceUuid UUID of the BLE service
  * @param characteristicUuid UUID of the BLE characteristic
+ * @param descriptorUuid UUID of the descriptor
+ * @param binaryData binary data
  */
-void BleCentral::stopNotification(int scId, int ecId
-                                  , const QString& deviceId
-                                  , const QString& serviceUuid
-                                  , const QString& characteristicUuid) {
-  Q_UNUSED(serviceUuid);
-
-  if (!_connectedDevice) {
-    this->cb(ecId,
-             QString("Not connected to device %1")
-               .arg(deviceId));
+void BleCentral::writeDescriptor(int scId, int ecId
+                                 , const QString& deviceId
+                                 , const QString& serviceUuid
+                                 , const QString& characteristicUuid
+                                 , const QString& descriptorUuid
+                                 , const QString& binaryData) {
+  BlePeripheral *peripheral = linkFor(ecId, deviceId);
+  if (!peripheral) {
     return;
   }
 
-  if (_connectedDevice->remoteAddress().toString() != deviceId) {
-    // TODO i8n
-    this->cb(ecId,
-             QString("Not connected to device %1 but to device %2")
-               .arg(deviceId)
-               .arg(_connectedDevice->remoteAddress().toString()));
-    return;
-  }
+  BlePeripheral::Operation operation;
+  operation.type = BlePeripheral::WriteDescriptor;
+  operation.service = btUuidFromUuidString(serviceUuid);
+  operation.characteristic = btUuidFromUuidString(characteristicUuid);
+  operation.descriptor = btUuidFromUuidString(descriptorUuid);
+  operation.value = QByteArray::fromBase64(binaryData.toUtf8());
+  operation.success = [=](const QByteArray&) {
+    this->cb(scId, QLatin1String("DescriptorWritten"));
+  };
+  operation.failure = [=](const QString& error) {
+    this->cb(ecId, error);
+  };
 
-  /*
-  if (_connectedCallbackIdsPerSlotSignature.contains(
-         characteristicUuid)) {
-    // TODO fix this, not remove
-    _connectedCallbackIdsPerSlotSignature
-      .remove(characteristicUuid);
+  _scheduler.submit(peripheral, BleScheduler::Interactive, operation);
+}
 
-    this->cb(scId, "");
-  } else {
-    this->cb(ecId, "No notifications started for characteristic");
+/**
+ * @brief BleCentral::setTimeouts
+ *
+ * Function setTimeouts sets the deadlines of connections and GATT
+ * operations, in ms, 0 for none. Operations failing their deadline are
+ * reported with "Operation timed out", connections with "Connection timed
+ * out". Options not given keep their value.
+ *
+ * @param scId
+ * @param ecId
+ * @param options connect, read, write (with and without response),
+ *                descriptor (descriptor reads and writes, including
+ *                enabling notifications)
+ */
+void BleCentral::setTimeouts(int scId, int ecId
+                             , const QVariantMap& options) {
+  Q_UNUSED(ecId);
+
+  _connectTimeout = qMax(0, options.value("connect", _connectTimeout).toInt());
+  _readTimeout = qMax(0, options.value("read", _readTimeout).toInt());
+  _writeTimeout = qMax(0, options.value("write", _writeTimeout).toInt());
+  _descriptorTimeout =
+    qMax(0, options.value("descriptor", _descriptorTimeout).toInt());
+
+  Q_FOREACH(BlePeripheral *peripheral, _peripherals.peripherals()) {
+    applyTimeouts(peripheral);
   }
-  */
+  this->cb(scId, "");
 }
 
 /**
- * @brief BleCentral::isEnabled
+ * @brief BleCentral::cancelOperations
  *
- * Function isEnabled calls the success callback when Bluetooth is enabled
- * and the failure callback when Bluetooth is not enabled
+ * Function cancelOperations fails the operation in progress and the
+ * queued operations of a peripheral with "Operation cancelled".
  *
  * @param scId
  * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
  */
-void BleCentral::isEnabled(int scId, int ecId) {
-  QBluetoothLocalDevice device;
-  if (device.isValid()) {
-    this->cb(scId, "enabled");
-  } else {
-    this->cb(ecId, "disabled");
+void BleCentral::cancelOperations(int scId, int ecId
+                                  , const QString& deviceId) {
+  BlePeripheral *peripheral = peripheralFor(ecId, deviceId);
+  if (!peripheral) {
+    return;
   }
+
+  // TODO i8n
+  const QString error = QLatin1String("Operation cancelled");
+  _scheduler.cancel(peripheral->handle(), error);
+  peripheral->cancelAll(error);
+  this->cb(scId, "");
 }
 
 /**
- * @brief BleCentral::isConnected
+ * @brief BleCentral::setConnectionPool
  *
- * Function isConnected calls the success callback when the peripheral is
- * connected and the failure callback when not connected
+ * Function setConnectionPool lets GATT calls address peripherals that are
+ * not connected, by MAC address. A link is opened on demand and kept
+ * after the call; once maxConnections links are up, the least recently
+ * used idle pooled link is closed to make room. Calls wait for a link in
+ * the order they arrive. Links opened by connect are never evicted but
+ * count against the limit. maxConnections 0 disables pooling, links
+ * already open stay until they go down.
  *
  * @param scId
  * @param ecId
- * @param deviceId UUID or MAC address of the peripheral
+ * @param options maxConnections
  */
-void BleCentral::isConnected(int scId, int ecId
-                             , const QString& deviceId) {
-  if (_connectedDevice
-      && _connectedDevice->remoteAddress().toString() == deviceId) {
-    this->cb(scId, "connected");
-  } else {
-    this->cb(ecId, "disconnected");
+void BleCentral::setConnectionPool(int scId, int ecId
+                                   , const QVariantMap& options) {
+  bool ok = false;
+  const int maxLinks = options.value("maxConnections").toInt(&ok);
+  if (!ok || maxLinks < 0) {
+    // TODO i8n
+    this->cb(ecId, "Invalid maxConnections");
+    return;
+  }
+
+  _linkPool.setMaxLinks(maxLinks);
+  if (maxLinks == 0) {
+    while (_linkPool.waiting() > 0) {
+      // TODO i8n
+      closeLink(_linkPool.takeWaiting(), "Connection pool disabled");
+    }
   }
+  pumpLinks();
+  this->cb(scId, "");
 }
 
 /**
- * @brief BleCentral::startStateNotifications
+ * @brief BleCentral::requestMtu
  *
- * Function startStateNotifications calls the success callback when the
- * Bluetooth is enabled or disabled on the device
+ * Function requestMtu calls the success callback with the ATT MTU of the
+ * link. Qt does not let the central ask for an MTU, the stack exchanges
+ * the largest it supports when connecting, so mtu is not sent to the
+ * peripheral. Writes without response are split at the MTU.
  *
  * @param scId
  * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @param mtu MTU the app would like
  */
-void BleCentral::startStateNotifications(int scId, int ecId) {
-  Q_UNUSED(scId);
-  this->cb(ecId, "NOT IMPLEMENTED");
+void BleCentral::requestMtu(int scId, int ecId
+                            , const QString& deviceId
+                            , int mtu) {
+  Q_UNUSED(mtu);
+
+  BlePeripheral *peripheral = peripheralFor(ecId, deviceId);
+  if (!peripheral) {
+    return;
+  }
+  this->cb(scId, peripheral->link().mtu);
 }
 
 /**
- * @brief BleCentral::stopStateNotifications
+ * @brief BleCentral::requestConnectionPriority
  *
- * Function stopStateNotifications calls the success callback when Bluetooth state
- * notifications have been stopped
+ * Function requestConnectionPriority asks the peripheral for connection
+ * parameters favouring latency and throughput ("high"), power ("low") or
+ * a trade-off ("balanced"). Success is called with the link once the
+ * peripheral accepted the update, failure if it refused or did not answer
+ * within the write timeout.
  *
  * @param scId
  * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @param priority "high", "balanced" or "low"
  */
-void BleCentral::stopStateNotifications(int scId, int ecId) {
+void BleCentral::requestConnectionPriority(int scId, int ecId
+                                           , const QString& deviceId
+                                           , const QString& priority) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
+  QLowEnergyConnectionParameters parameters;
+  if (priority == QLatin1String("high")) {
+    parameters.setIntervalRange(7.5, 15);
+    parameters.setLatency(0);
+    parameters.setSupervisionTimeout(5000);
+  } else if (priority == QLatin1String("balanced")) {
+    parameters.setIntervalRange(30, 50);
+    parameters.setLatency(0);
+    parameters.setSupervisionTimeout(5000);
+  } else if (priority == QLatin1String("low")) {
+    parameters.setIntervalRange(100, 125);
+    parameters.setLatency(2);
+    parameters.setSupervisionTimeout(20000);
+  } else {
+    // TODO i8n
+    this->cb(ecId, QString("Unknown connection priority %1").arg(priority));
+    return;
+  }
+
+  BlePeripheral *peripheral = peripheralFor(ecId, deviceId);
+  if (!peripheral) {
+    return;
+  }
+  if (peripheral->isSimulated()) {
+    sendLink(scId, peripheral, false);
+    return;
+  }
+
+  QLowEnergyController *controller = peripheral->controller();
+
+  // released once updated, on error and on timeout
+  const BleConnectionPool::Group group = _connections.acquire(controller);
+
+  const BleTimerWheel::Handle timeout = _writeTimeout <= 0 ? 0 :
+    _timers.schedule(_writeTimeout, [=]() {
+        group.release();
+        // TODO i8n
+        this->cb(ecId, "Connection update timed out");
+      });
+
+  group.connect(controller,
+                &QLowEnergyController::connectionUpdated,
+                [=]() {
+                  group.release();
+                  _timers.cancel(timeout);
+                  sendLink(scId, peripheral, false);
+                });
+
+  void (QLowEnergyController::* controllerErrorMethodPtr)(
+        QLowEnergyController::Error)
+    = &QLowEnergyController::error;
+  group.connect(controller,
+                controllerErrorMethodPtr,
+                [=]() {
+                  group.release();
+                  _timers.cancel(timeout);
+                  this->cb(ecId,
+                           QString("Error: %1").arg(
+                               controller->errorString()));
+                });
+
+  controller->requestConnectionUpdate(parameters);
+#else
   Q_UNUSED(scId);
-  this->cb(ecId, "NOT IMPLEMENTED");
+  Q_UNUSED(deviceId);
+  Q_UNUSED(priority);
+  // TODO i8n
+  this->cb(ecId, "Connection priority not supported");
+#endif
 }
 
 /**
- * @brief BleCentral::enable
+ * @brief BleCentral::startLinkNotifications
  *
- * Function enable prompts the user to enable Bluetooth
+ * Function startLinkNotifications calls the success callback with the
+ * link state of the peripheral, then again whenever the connection
+ * parameters or the MTU change.
  *
  * @param scId
  * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
  */
-void BleCentral::enable(int scId, int ecId) {
-  Q_UNUSED(ecId);
-  QBluetoothLocalDevice device;
-  // TODO complete
-  device.powerOn();
-  this->cb(scId, "enabled");
+void BleCentral::startLinkNotifications(int scId, int ecId
+                                        , const QString& deviceId) {
+  BlePeripheral *peripheral = peripheralFor(ecId, deviceId);
+  if (!peripheral) {
+    return;
+  }
+
+  peripheral->setLinkCallback([=]() {
+      sendLink(scId, peripheral, true);
+    });
+  sendLink(scId, peripheral, true);
 }
 
 /**
- * @brief BleCentral::readRSSI
- *
- * Samples the RSSI value (a measure of signal strength) on the connection
- * to a bluetooth device.
- * Requires that you have established a connection before invoking
- * (otherwise an error will be raised)
+ * @brief BleCentral::stopLinkNotifications
  *
  * @param scId
  * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
  */
-void BleCentral::readRSSI(int scId, int ecId
+void BleCentral::stopLinkNotifications(int scId, int ecId
+                                       , const QString& deviceId) {
+  BlePeripheral *peripheral = peripheralFor(ecId, deviceId);
+  if (!peripheral) {
+    return;
+  }
+
+  peripheral->setLinkCallback(BlePeripheral::LinkCallback());
+  this->cb(scId, "");
+}
+
+/**
+ * @brief BleCentral::readMany
+ *
+ * Function readMany reads several characteristics back to back on the
+ * peripheral's operation queue.
+ * The success callback is called once with one result per read, in
+ * order: {service, characteristic, status: "ok", value: ArrayBuffer}
+ * or {service, characteristic, status: "error", error}
+ *
+ * @param scId
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @param reads list of [serviceUuid, characteristicUuid]
+ */
+void BleCentral::readMany(int scId, int ecId
+                          , const QString& deviceId
+                          , const QVariantList& reads) {
+  BlePeripheral *peripheral = linkFor(ecId, deviceId);
+  if (!peripheral) {
+    return;
+  }
+
+  QList<BlePeripheral::Operation> operations;
+  Q_FOREACH(const QVariant& read, reads) {
+    const QVariantList tuple = read.toList();
+    if (tuple.size() < 2) {
+      // TODO i8n
+      this->cb(ecId, QLatin1String("Expected [service, characteristic]"));
+      return;
+    }
+
+    BlePeripheral::Operation operation;
+    operation.type = BlePeripheral::ReadCharacteristic;
+    operation.service = btUuidFromUuidString(tuple.at(0).toString());
+    operation.characteristic = btUuidFromUuidString(tuple.at(1).toString());
+    operations.append(operation);
+  }
+
+  enqueueBatch(scId, peripheral, operations, reads);
+}
+
+/**
+ * @brief BleCentral::writeMany
+ *
+ * Function writeMany writes several characteristics back to back on the
+ * peripheral's operation queue.
+ * The success callback is called once with one result per write, in
+ * order: {service, characteristic, status: "ok"}
+ * or {service, characteristic, status: "error", error}
+ *
+ * @param scId
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @param writes list of [serviceUuid, characteristicUuid, base64 value]
+ */
+void BleCentral::writeMany(int scId, int ecId
+                           , const QString& deviceId
+                           , const QVariantList& writes) {
+  BlePeripheral *peripheral = linkFor(ecId, deviceId);
+  if (!peripheral) {
+    return;
+  }
+
+  QList<BlePeripheral::Operation> operations;
+  Q_FOREACH(const QVariant& write, writes) {
+    const QVariantList tuple = write.toList();
+    if (tuple.size() < 3) {
+      // TODO i8n
+      this->cb(ecId,
+               QLatin1String("Expected [service, characteristic, value]"));
+      return;
+    }
+
+    BlePeripheral::Operation operation;
+    operation.type = BlePeripheral::WriteCharacteristic;
+    operation.service = btUuidFromUuidString(tuple.at(0).toString());
+    operation.characteristic = btUuidFromUuidString(tuple.at(1).toString());
+    operation.value = QByteArray::fromBase64(tuple.at(2).toString().toUtf8());
+    operations.append(operation);
+  }
+
+  enqueueBatch(scId, peripheral, operations, writes);
+}
+
+void BleCentral::enqueueBatch(int scId,
+                              BlePeripheral *peripheral,
+                              QList<BlePeripheral::Operation> operations,
+                              const QVariantList& tuples) {
+  struct BatchResult {
+    bool ok;
+    QByteArray value;
+    QString error;
+  };
+
+  const int count = operations.size();
+  auto results = std::make_shared<QVector<BatchResult>>(count);
+  auto remaining = std::make_shared<int>(count);
+
+  auto finish = [=]() {
+    BleJsonWriter& writer = peripheral->messageWriter();
+    writer.reset();
+    writer.beginArray();
+    for (int i = 0; i < count; ++i) {
+      const QVariantList tuple = tuples.at(i).toList();
+      const BatchResult& result = results->at(i);
+
+      writer.beginObject();
+      writer.key(QLatin1String("service"));
+      writer.value(tuple.at(0).toString());
+      writer.key(QLatin1String("characteristic"));
+      writer.value(tuple.at(1).toString());
+      writer.key(QLatin1String("status"));
+      writer.value(result.ok ? QLatin1String("ok") : QLatin1String("error"));
+      if (!result.ok) {
+        writer.key(QLatin1String("error"));
+        writer.value(result.error);
+      } else if (!result.value.isNull()) {
+        writer.key(QLatin1String("value"));
+        writer.arrayBuffer(result.value.constData(), result.value.size());
+      }
+      writer.endObject();
+    }
+    writer.endArray();
+
+    this->callback(scId, writer.text());
+  };
+
+  if (count == 0) {
+    finish();
+    return;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    BlePeripheral::Operation& operation = operations[i];
+    const bool isRead = operation.type == BlePeripheral::ReadCharacteristic;
+
+    operation.success = [=](const QByteArray& value) {
+      BatchResult& result = (*results)[i];
+      result.ok = true;
+      if (isRead) {
+        result.value = value;
+      }
+      if (--*remaining == 0) {
+        finish();
+      }
+    };
+    operation.failure = [=](const QString& error) {
+      BatchResult& result = (*results)[i];
+      result.ok = false;
+      result.error = error;
+      if (--*remaining == 0) {
+        finish();
+      }
+    };
+  }
+
+  // one job, so nothing else runs in between
+  _scheduler.submit(peripheral, BleScheduler::Interactive, operations);
+}
+
+/**
+ * @brief BleCentral::writeTransaction
+ *
+ * Function writeTransaction writes several characteristics as a unit: the
+ * writes run back to back on the peripheral's operation queue and the
+ * first failure aborts the ones not started yet. With the rollback
+ * option the values are read first and the writes already done are
+ * undone, in reverse order, when the transaction aborts.
+ * The success callback is called with {status: "committed", writes}, the
+ * failure callback with {status: "aborted", "rolledBack" or "partial",
+ * error, writes}; writes has one {service, characteristic, status} per
+ * write, in order, status being "ok", "error", "aborted", "rolledBack" or
+ * "rollbackFailed".
+ *
+ * @param scId
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @param writes list of [serviceUuid, characteristicUuid, base64 value]
+ * @param options rollback: bool, priority: "control", "interactive"
+ *        (default) or "bulk"
+ */
+void BleCentral::writeTransaction(int scId, int ecId
+                                  , const QString& deviceId
+                                  , const QVariantList& writes
+                                  , const QVariantMap& options) {
+  BleScheduler::Priority priority;
+  if (!priorityFor(ecId, options, &priority)) {
+    return;
+  }
+  BlePeripheral *peripheral = linkFor(ecId, deviceId);
+  if (!peripheral) {
+    return;
+  }
+
+  enum WriteStatus {
+    Pending,
+    Written,
+    Failed,
+    Aborted,
+    RolledBack,
+    RollbackFailed
+  };
+
+  struct Transaction {
+    QVector<BlePeripheral::Operation> writes;
+    QVector<WriteStatus> statuses;
+    // values before the transaction, read when rolling back
+    QVector<QByteArray> before;
+    QString error;
+    bool failed;
+    // operations of the transaction and rollback writes not done yet
+    int remaining;
+    int rollbacks;
+  };
+
+  auto transaction = std::make_shared<Transaction>();
+  transaction->failed = false;
+  transaction->rollbacks = 0;
+
+  Q_FOREACH(const QVariant& write, writes) {
+    const QVariantList tuple = write.toList();
+    if (tuple.size() < 3) {
+      // TODO i8n
+      this->cb(ecId,
+               QLatin1String("Expected [service, characteristic, value]"));
+      return;
+    }
+
+    BlePeripheral::Operation operation;
+    operation.type = BlePeripheral::WriteCharacteristic;
+    operation.service = btUuidFromUuidString(tuple.at(0).toString());
+    operation.characteristic = btUuidFromUuidString(tuple.at(1).toString());
+    operation.value = QByteArray::fromBase64(tuple.at(2).toString().toUtf8());
+    transaction->writes.append(operation);
+  }
+
+  const int count = transaction->writes.size();
+  const bool rollback = options.value("rollback", false).toBool();
+  transaction->statuses.fill(Pending, count);
+  transaction->before.resize(count);
+
+  auto finish = [=]() {
+    bool applied = false;
+    bool rolledBack = false;
+    Q_FOREACH(WriteStatus status, transaction->statuses) {
+      applied |= status == Written || status == RollbackFailed;
+      rolledBack |= status == RolledBack;
+    }
+
+    BleJsonWriter& writer = peripheral->messageWriter();
+    writer.reset();
+    writer.beginObject();
+    writer.key(QLatin1String("status"));
+    if (!transaction->failed) {
+      writer.value(QLatin1String("committed"));
+    } else if (applied) {
+      writer.value(QLatin1String("partial"));
+    } else if (rolledBack) {
+      writer.value(QLatin1String("rolledBack"));
+    } else {
+      writer.value(QLatin1String("aborted"));
+    }
+    if (transaction->failed) {
+      writer.key(QLatin1String("error"));
+      writer.value(transaction->error);
+    }
+
+    static const char *const names[] = {
+      "pending", "ok", "error", "aborted", "rolledBack", "rollbackFailed"
+    };
+    writer.key(QLatin1String("writes"));
+    writer.beginArray();
+    for (int i = 0; i < count; ++i) {
+      const QVariantList tuple = writes.at(i).toList();
+      writer.beginObject();
+      writer.key(QLatin1String("service"));
+      writer.value(tuple.at(0).toString());
+      writer.key(QLatin1String("characteristic"));
+      writer.value(tuple.at(1).toString());
+      writer.key(QLatin1String("status"));
+      writer.value(QLatin1String(names[transaction->statuses.at(i)]));
+      writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+
+    this->callback(transaction->failed ? ecId : scId, writer.text());
+  };
+
+  auto done = [=]() {
+    if (--transaction->remaining == 0 && transaction->rollbacks == 0) {
+      finish();
+    }
+  };
+
+  // the first failure aborts the rest of the transaction, the writes
+  // done so far are undone in reverse order
+  auto abortTransaction = [=](const QString& error) {
+    transaction->failed = true;
+    transaction->error = error;
+    if (!rollback) {
+      return;
+    }
+    QList<BlePeripheral::Operation> undos;
+    for (int i = count - 1; i >= 0; --i) {
+      if (transaction->statuses.at(i) != Written) {
+        continue;
+      }
+      BlePeripheral::Operation undo = transaction->writes.at(i);
+      undo.value = transaction->before.at(i);
+      undo.success = [=](const QByteArray&) {
+        transaction->statuses[i] = RolledBack;
+        if (--transaction->rollbacks == 0 && transaction->remaining == 0) {
+          finish();
+        }
+      };
+      undo.failure = [=](const QString&) {
+        transaction->statuses[i] = RollbackFailed;
+        if (--transaction->rollbacks == 0 && transaction->remaining == 0) {
+          finish();
+        }
+      };
+      ++transaction->rollbacks;
+      undos.append(undo);
+    }
+    // back to back in one job, ahead of the interactive and bulk work
+    if (!undos.isEmpty()) {
+      _scheduler.submit(peripheral, BleScheduler::Control, undos);
+    }
+  };
+
+  const quint64 id = ++_transactions;
+  QList<BlePeripheral::Operation> operations;
+  if (rollback) {
+    for (int i = 0; i < count; ++i) {
+      BlePeripheral::Operation read;
+      read.type = BlePeripheral::ReadCharacteristic;
+      read.service = transaction->writes.at(i).service;
+      read.characteristic = transaction->writes.at(i).characteristic;
+      read.transaction = id;
+      read.success = [=](const QByteArray& value) {
+        transaction->before[i] = value;
+        done();
+      };
+      read.failure = [=](const QString& error) {
+        if (!transaction->failed) {
+          abortTransaction(error);
+        }
+        done();
+      };
+      operations.append(read);
+    }
+  }
+  for (int i = 0; i < count; ++i) {
+    BlePeripheral::Operation write = transaction->writes.at(i);
+    write.transaction = id;
+    write.success = [=](const QByteArray&) {
+      transaction->statuses[i] = Written;
+      done();
+    };
+    write.failure = [=](const QString& error) {
+      if (transaction->failed) {
+        transaction->statuses[i] = Aborted;
+      } else {
+        transaction->statuses[i] = Failed;
+        abortTransaction(error);
+      }
+      done();
+    };
+    operations.append(write);
+  }
+
+  transaction->remaining = operations.size();
+  if (operations.isEmpty()) {
+    finish();
+    return;
+  }
+
+  // one job, so nothing else runs in between
+  _scheduler.submit(peripheral, priority, operations);
+}
+
+/**
+ * @brief BleCentral::startNotification
+ *
+ * Function startNotification registers a callback that is called every
+ * time the value of a characteristic changes.
+ * This method handles both notifications and indications.
+ * The success callback is called multiple times
+ *
+ * @param scId
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @param serviceUuid UUID of the BLE service
+ * @param characteristicUuid UUID of the BLE characteristic
+ */
+void BleCentral::startNotification(int scId, int ecId
+                                   , const QString& deviceId
+                                   , const QString& serviceUuid
+                                   , const QString& characteristicUuid) {
+  startNotificationInternal(scId, ecId, deviceId, serviceUuid,
+                            characteristicUuid, QVariantMap());
+}
+
+/**
+ * @brief BleCentral::startNotificationWithOptions
+ *
+ * Function startNotificationWithOptions works like startNotification, the
+ * options select a native decoder for the characteristic value, see
+ * BleSubscription::configure. Decoded notifications are delivered as an
+ * array of numbers instead of the raw value.
+ *
+ * @param scId
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @param serviceUuid UUID of the BLE service
+ * @param characteristicUuid UUID of the BLE characteristic
+ * @param options subscription options
+ */
+void BleCentral::startNotificationWithOptions(int scId, int ecId
+                                              , const QString& deviceId
+                                              , const QString& serviceUuid
+                                              , const QString& characteristicUuid
+                                              , const QVariantMap& options) {
+  startNotificationInternal(scId, ecId, deviceId, serviceUuid,
+                            characteristicUuid, options);
+}
+
+void BleCentral::startNotificationInternal(int scId, int ecId
+                                           , const QString& deviceId
+                                           , const QString& serviceUuid
+                                           , const QString& characteristicUuid
+                                           , const QVariantMap& options) {
+  BlePeripheral *peripheral = peripheralFor(ecId, deviceId);
+  if (!peripheral) {
+    return;
+  }
+
+  QScopedPointer<BleSubscription> subscription(
+    new BleSubscription([this, scId](const QString& message) {
+        this->callbackWithoutRemove(scId, message);
+      },
+      &_notificationCounters));
+  QString optionsError;
+  if (!subscription->configure(options, &optionsError)) {
+    this->cb(ecId, optionsError);
+    return;
+  }
+
+  peripheral->subscribe(
+      btUuidFromUuidString(serviceUuid),
+      btUuidFromUuidString(characteristicUuid),
+      subscription.take(),
+      BlePeripheral::SuccessCallback(),
+      [=](const QString& error) {
+        this->cb(ecId, error);
+      });
+}
+
+/**
+ * @brief BleCentral::stopNotification
+ *
+ * Function stopNotification stops a previously registered notification callback
+ *
+ * @param scId
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ * @param serviceUuid UUID of the BLE service
+ * @param characteristicUuid UUID of the BLE characteristic
+ */
+void BleCentral::stopNotification(int scId, int ecId
+                                  , const QString& deviceId
+                                  , const QString& serviceUuid
+                                  , const QString& characteristicUuid) {
+  BlePeripheral *peripheral = peripheralFor(ecId, deviceId);
+  if (!peripheral) {
+    return;
+  }
+
+  const bool subscribed = peripheral->unsubscribe(
+      btUuidFromUuidString(serviceUuid),
+      btUuidFromUuidString(characteristicUuid),
+      [=](const QByteArray&) {
+        this->cb(scId, "");
+      },
+      [=](const QString& error) {
+        this->cb(ecId, error);
+      });
+  if (!subscribed) {
+    // TODO i8n
+    this->cb(ecId, "No notifications started for characteristic");
+  }
+}
+
+/**
+ * @brief BleCentral::startNotificationGroup
+ *
+ * Function startNotificationGroup subscribes to a characteristic on
+ * several peripherals and merges their notifications into one stream
+ * ordered by time, see BleMergedStream. The success callback is called
+ * with batches of samples: [{device, t, value}, ...] where device is the
+ * index in deviceIds and t the time in ms.
+ *
+ * @param scId
+ * @param ecId
+ * @param deviceIds handles or MAC addresses of the peripherals
+ * @param serviceUuid UUID of the BLE service
+ * @param characteristicUuid UUID of the BLE characteristic
+ * @param options see BleMergedStream::configure()
+ */
+void BleCentral::startNotificationGroup(int scId, int ecId
+                                        , const QVariantList& deviceIds
+                                        , const QString& serviceUuid
+                                        , const QString& characteristicUuid
+                                        , const QVariantMap& options) {
+  const QBluetoothUuid service = btUuidFromUuidString(serviceUuid);
+  const QBluetoothUuid characteristic =
+    btUuidFromUuidString(characteristicUuid);
+  const BlePeripheral::CharacteristicKey key(service, characteristic);
+  if (_streams.contains(key)) {
+    // TODO i8n
+    this->cb(ecId, "Notification group already started for characteristic");
+    return;
+  }
+  if (deviceIds.isEmpty()) {
+    // TODO i8n
+    this->cb(ecId, "No devices");
+    return;
+  }
+
+  QVector<BlePeripheral *> members;
+  Q_FOREACH(const QVariant& deviceId, deviceIds) {
+    BlePeripheral *peripheral = peripheralFor(ecId, deviceId.toString());
+    if (!peripheral) {
+      return;
+    }
+    members.append(peripheral);
+  }
+
+  QSharedPointer<BleMergedStream> stream(
+    new BleMergedStream([this, scId](const QString& message) {
+        this->callbackWithoutRemove(scId, message);
+      }));
+  QString error;
+  if (!stream->configure(options, &error)) {
+    this->cb(ecId, error);
+    return;
+  }
+  _streams.insert(key, stream);
+
+  const QWeakPointer<BleMergedStream> target = stream;
+  Q_FOREACH(BlePeripheral *peripheral, members) {
+    const int source = stream->addSource(peripheral->address());
+    BleSubscription *subscription =
+      new BleSubscription(BleSubscription::Sink(), &_notificationCounters);
+    subscription->setTap([target, source](const QByteArray& value) {
+        if (QSharedPointer<BleMergedStream> merged = target.toStrongRef()) {
+          merged->push(source, value);
+        }
+      });
+    peripheral->subscribe(service, characteristic, subscription,
+                          BlePeripheral::SuccessCallback(),
+                          [=](const QString& error) {
+                            this->cb(ecId, error);
+                          });
+  }
+}
+
+/**
+ * @brief BleCentral::stopNotificationGroup
+ *
+ * Function stopNotificationGroup sends the samples still held, then stops
+ * the notifications of the group on the peripherals still connected.
+ *
+ * @param scId
+ * @param ecId
+ * @param serviceUuid UUID of the BLE service
+ * @param characteristicUuid UUID of the BLE characteristic
+ */
+void BleCentral::stopNotificationGroup(int scId, int ecId
+                                       , const QString& serviceUuid
+                                       , const QString& characteristicUuid) {
+  const QBluetoothUuid service = btUuidFromUuidString(serviceUuid);
+  const QBluetoothUuid characteristic =
+    btUuidFromUuidString(characteristicUuid);
+  const QSharedPointer<BleMergedStream> stream =
+    _streams.take(BlePeripheral::CharacteristicKey(service, characteristic));
+  if (!stream) {
+    // TODO i8n
+    this->cb(ecId, "No notification group started for characteristic");
+    return;
+  }
+
+  stream->flushAll();
+  for (int i = 0; i < stream->sourceCount(); ++i) {
+    BlePeripheral *peripheral = _peripherals.findAddress(stream->address(i));
+    if (peripheral) {
+      // failing to write the descriptor leaves nothing to clean up
+      peripheral->unsubscribe(service, characteristic,
+                              [](const QByteArray&) {},
+                              [](const QString&) {});
+    }
+  }
+  this->cb(scId, "");
+}
+
+/**
+ * @brief BleCentral::isEnabled
+ *
+ * Function isEnabled calls the success callback when Bluetooth is enabled
+ * and the failure callback when Bluetooth is not enabled
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::isEnabled(int scId, int ecId) {
+  if (localDevice()->isValid()) {
+    this->cb(scId, "enabled");
+  } else {
+    this->cb(ecId, "disabled");
+  }
+}
+
+/**
+ * @brief BleCentral::isConnected
+ *
+ * Function isConnected calls the success callback when the peripheral is
+ * connected and the failure callback when not connected
+ *
+ * @param scId
+ * @param ecId
+ * @param deviceId handle or MAC address of the peripheral
+ */
+void BleCentral::isConnected(int scId, int ecId
+                             , const QString& deviceId) {
+  if (_peripherals.find(deviceId)) {
+    this->cb(scId, "connected");
+  } else {
+    this->cb(ecId, "disconnected");
+  }
+}
+
+/**
+ * @brief BleCentral::startStateNotifications
+ *
+ * Function startStateNotifications calls the success callback when the
+ * Bluetooth is enabled or disabled on the device
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::startStateNotifications(int scId, int ecId) {
+  Q_UNUSED(scId);
+  this->cb(ecId, "NOT IMPLEMENTED");
+}
+
+/**
+ * @brief BleCentral::stopStateNotifications
+ *
+ * Function stopStateNotifications calls the success callback when Bluetooth state
+ * notifications have been stopped
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::stopStateNotifications(int scId, int ecId) {
+  Q_UNUSED(scId);
+  this->cb(ecId, "NOT IMPLEMENTED");
+}
+
+/**
+ * @brief BleCentral::enable
+ *
+ * Function enable prompts the user to enable Bluetooth
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::enable(int scId, int ecId) {
+  Q_UNUSED(ecId);
+  // TODO complete
+  localDevice()->powerOn();
+  this->cb(scId, "enabled");
+}
+
+/**
+ * @brief BleCentral::readRSSI
+ *
+ * Samples the RSSI value (a measure of signal strength) on the connection
+ * to a bluetooth device.
+ * Requires that you have established a connection before invoking
+ * (otherwise an error will be raised)
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::readRSSI(int scId, int ecId
                           , const QString& deviceId) {
   Q_UNUSED(scId);
   Q_UNUSED(deviceId);
   this->cb(ecId, "NOT IMPLEMENTED");
 }
+
+/**
+ * @brief BleCentral::getStatistics
+ *
+ * Function getStatistics calls the success callback with the counters of
+ * the plugin: notifications delivered to and filtered before JavaScript,
+ * or dropped as malformed,
+ * in total and per subscription of the connected peripherals, the message
+ * buffers of the peripherals, the queue and latencies of the operation
+ * scheduler, the signal connections held by pending operations and the
+ * startup profile.
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::getStatistics(int scId, int ecId) {
+  Q_UNUSED(ecId);
+
+  BleJsonWriter writer;
+  writer.beginObject();
+
+  writer.key(QLatin1String("notifications"));
+  writer.beginObject();
+  writer.key(QLatin1String("delivered"));
+  writer.value(qint64(_notificationCounters.delivered));
+  writer.key(QLatin1String("filtered"));
+  writer.value(qint64(_notificationCounters.filtered));
+  writer.key(QLatin1String("malformed"));
+  writer.value(qint64(_notificationCounters.malformed));
+
+  writer.key(QLatin1String("subscriptions"));
+  writer.beginArray();
+  Q_FOREACH(BlePeripheral *peripheral, _peripherals.peripherals()) {
+    const QHash<BlePeripheral::CharacteristicKey, BleSubscription *>&
+      subscriptions = peripheral->subscriptions();
+    for (auto it = subscriptions.constBegin();
+         it != subscriptions.constEnd();
+         ++it) {
+      writer.beginObject();
+      writer.key(QLatin1String("id"));
+      writeAddress(writer, peripheral->address());
+      writer.key(QLatin1String("service"));
+      writer.value(BleUuid::toString(it.key().first));
+      writer.key(QLatin1String("characteristic"));
+      writer.value(BleUuid::toString(it.key().second));
+      writer.key(QLatin1String("delivered"));
+      writer.value(qint64(it.value()->counters().delivered));
+      writer.key(QLatin1String("filtered"));
+      writer.value(qint64(it.value()->counters().filtered));
+      writer.key(QLatin1String("malformed"));
+      writer.value(qint64(it.value()->counters().malformed));
+      writer.endObject();
+    }
+  }
+  writer.endArray();
+  writer.endObject();
+
+  // message buffers of the connected peripherals
+  int capacity = 0;
+  int allocations = 0;
+  Q_FOREACH(BlePeripheral *peripheral, _peripherals.peripherals()) {
+    capacity += peripheral->messageWriter().capacity();
+    allocations += peripheral->messageWriter().allocations();
+  }
+  writer.key(QLatin1String("buffers"));
+  writer.beginObject();
+  writer.key(QLatin1String("capacity"));
+  writer.value(capacity);
+  writer.key(QLatin1String("allocations"));
+  writer.value(allocations);
+  writer.key(QLatin1String("scan"));
+  writer.beginObject();
+  writer.key(QLatin1String("capacity"));
+  writer.value(_scanWriter.capacity());
+  writer.key(QLatin1String("allocations"));
+  writer.value(_scanWriter.allocations());
+  writer.endObject();
+  writer.endObject();
+
+  writer.key(QLatin1String("scheduler"));
+  _scheduler.write(writer);
+
+  writer.key(QLatin1String("pool"));
+  _linkPool.write(writer, links());
+
+  writer.key(QLatin1String("presence"));
+  _presence.write(writer);
+
+  writer.key(QLatin1String("groups"));
+  writer.beginArray();
+  for (auto it = _streams.constBegin(); it != _streams.constEnd(); ++it) {
+    writer.beginObject();
+    writer.key(QLatin1String("service"));
+    writer.value(BleUuid::toString(it.key().first));
+    writer.key(QLatin1String("characteristic"));
+    writer.value(BleUuid::toString(it.key().second));
+    writer.key(QLatin1String("stream"));
+    it.value()->write(writer);
+    writer.endObject();
+  }
+  writer.endArray();
+
+  writer.key(QLatin1String("links"));
+  writer.beginArray();
+  Q_FOREACH(BlePeripheral *peripheral, _peripherals.peripherals()) {
+    const BlePeripheral::Link& link = peripheral->link();
+    writer.beginObject();
+    writer.key(QLatin1String("id"));
+    writeAddress(writer, peripheral->address());
+    writer.key(QLatin1String("mtu"));
+    writer.value(link.mtu);
+    writer.key(QLatin1String("interval"));
+    writer.value(link.interval);
+    writer.key(QLatin1String("latency"));
+    writer.value(link.latency);
+    writer.key(QLatin1String("supervisionTimeout"));
+    writer.value(link.supervisionTimeout);
+    writer.key(QLatin1String("updates"));
+    writer.value(qint64(link.updates));
+    writer.key(QLatin1String("packets"));
+    writer.value(qint64(link.packets));
+    writer.endObject();
+  }
+  writer.endArray();
+
+  writer.key(QLatin1String("connections"));
+  writer.beginObject();
+  writer.key(QLatin1String("live"));
+  writer.value(_connections.liveConnections());
+  writer.key(QLatin1String("groups"));
+  writer.value(_connections.groupsInUse());
+  writer.key(QLatin1String("pooled"));
+  writer.value(_connections.capacity());
+  writer.key(QLatin1String("overflows"));
+  writer.value(_connections.overflows());
+  writer.endObject();
+
+  writer.key(QLatin1String("startup"));
+  _startup.write(writer);
+
+  writer.endObject();
+  this->callback(scId, writer.text());
+}
+
+/**
+ * @brief BleCentral::warmUp
+ *
+ * Function warmUp builds the discovery agent and the local adapter, left
+ * out of the plugin construction, once the event loop is back, and calls
+ * the success callback with the startup profile. Applications call it
+ * after their first frame to keep the first scan from paying for them.
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::warmUp(int scId, int ecId) {
+  Q_UNUSED(ecId);
+
+  // the Qt objects belong to the plugin thread, the work is only deferred
+  QTimer::singleShot(0, this, [=]() {
+      discoveryAgent();
+      localDevice();
+
+      BleJsonWriter writer;
+      _startup.write(writer);
+      this->callback(scId, writer.text());
+    });
+}
+
+/**
+ * @brief BleCentral::getResourceUsage
+ *
+ * Function getResourceUsage calls the success callback with the resources
+ * held by the plugin and the process: Qt objects owned by the plugin,
+ * peripherals, subscriptions, signal connections, resident memory and
+ * open file descriptors. Soak tests sample it between connection cycles,
+ * none of these may grow once the cycles run.
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::getResourceUsage(int scId, int ecId) {
+  Q_UNUSED(ecId);
+
+  int subscriptions = 0;
+  Q_FOREACH(BlePeripheral *peripheral, _peripherals.peripherals()) {
+    subscriptions += peripheral->subscriptions().size();
+  }
+
+  BleJsonWriter writer;
+  writer.beginObject();
+  writer.key(QLatin1String("objects"));
+  writer.value(BleResourceUsage::objectCount(this));
+  writer.key(QLatin1String("peripherals"));
+  writer.value(_peripherals.peripherals().size());
+  writer.key(QLatin1String("subscriptions"));
+  writer.value(subscriptions);
+  writer.key(QLatin1String("connections"));
+  writer.value(_connections.liveConnections());
+  writer.key(QLatin1String("connectionGroups"));
+  writer.value(_connections.groupsInUse());
+
+  writer.key(QLatin1String("rss"));
+  const qint64 rss = BleResourceUsage::residentSetSize();
+  if (rss < 0) {
+    writer.null();
+  } else {
+    writer.value(rss);
+  }
+  writer.key(QLatin1String("fds"));
+  const int fds = BleResourceUsage::openFileDescriptors();
+  if (fds < 0) {
+    writer.null();
+  } else {
+    writer.value(fds);
+  }
+  writer.endObject();
+  this->callback(scId, writer.text());
+}
+
+/**
+ * @brief BleCentral::dumpJournal
+ *
+ * Function dumpJournal calls the success callback with a snapshot of the
+ * event journal: the most recent scans, connections, state changes,
+ * errors and GATT operations with their queue depths.
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::dumpJournal(int scId, int ecId) {
+  Q_UNUSED(ecId);
+
+  BleJsonWriter writer(64 * 1024);
+  writer.beginObject();
+  writer.key(QLatin1String("recorded"));
+  writer.value(qint64(_journal.recorded()));
+  writer.key(QLatin1String("events"));
+  _journal.write(writer);
+  writer.endObject();
+  this->callback(scId, writer.text());
+}
+
+/**
+ * @brief BleCentral::startRecording
+ *
+ * Function startRecording records every notification of the connected
+ * peripheral into a capture file, see BleRecorder for the format.
+ * Subscriptions started with the deliver option set to false are recorded
+ * without crossing the bridge.
+ *
+ * @param scId
+ * @param ecId
+ * @param path capture file, relative to the application data directory
+ * @param options capacity in bytes, syncInterval in ms
+ */
+void BleCentral::startRecording(int scId, int ecId
+                                , const QString& path
+                                , const QVariantMap& options) {
+  QString error;
+  if (!_recorder.start(dataFilePath(path),
+                       options.value("capacity", 64 * 1024 * 1024)
+                         .toLongLong(),
+                       options.value("syncInterval", 1000).toInt(),
+                       &error)) {
+    this->cb(ecId, error);
+    return;
+  }
+
+  BleJsonWriter writer;
+  writeRecordingStatus(writer);
+  this->callback(scId, writer.text());
+}
+
+/**
+ * @brief BleCentral::stopRecording
+ *
+ * Function stopRecording stops the recording and calls the success
+ * callback with the final recording status.
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::stopRecording(int scId, int ecId) {
+  Q_UNUSED(ecId);
+
+  _recorder.stop();
+
+  BleJsonWriter writer;
+  writeRecordingStatus(writer);
+  this->callback(scId, writer.text());
+}
+
+/**
+ * @brief BleCentral::getRecordingStatus
+ *
+ * Function getRecordingStatus calls the success callback with the
+ * recording status.
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::getRecordingStatus(int scId, int ecId) {
+  Q_UNUSED(ecId);
+
+  BleJsonWriter writer;
+  writeRecordingStatus(writer);
+  this->callback(scId, writer.text());
+}
+
+void BleCentral::writeRecordingStatus(BleJsonWriter& writer) const {
+  writer.beginObject();
+  writer.key(QLatin1String("recording"));
+  writer.value(_recorder.isRecording());
+  writer.key(QLatin1String("path"));
+  writer.value(_recorder.path());
+  writer.key(QLatin1String("capacity"));
+  writer.value(_recorder.capacity());
+  writer.key(QLatin1String("bytesWritten"));
+  writer.value(_recorder.bytesWritten());
+  writer.key(QLatin1String("samples"));
+  writer.value(qint64(_recorder.samples()));
+  writer.key(QLatin1String("dropped"));
+  writer.value(qint64(_recorder.dropped()));
+  writer.endObject();
+}
+
+/**
+ * @brief BleCentral::startTrace
+ *
+ * Function startTrace records scan results, connections, GATT operations
+ * and notifications with their timing into a trace file, see BleTrace.
+ *
+ * @param scId
+ * @param ecId
+ * @param path trace file, relative to the application data directory
+ */
+void BleCentral::startTrace(int scId, int ecId, const QString& path) {
+  QString error;
+  if (!_trace.start(dataFilePath(path), &error)) {
+    this->cb(ecId, error);
+    return;
+  }
+  this->cb(scId, "");
+}
+
+/**
+ * @brief BleCentral::stopTrace
+ *
+ * Function stopTrace closes the trace file and calls the success callback
+ * with the number of traced events.
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::stopTrace(int scId, int ecId) {
+  if (!_trace.isTracing()) {
+    // TODO i8n
+    this->cb(ecId, "No trace is running");
+    return;
+  }
+  _trace.stop();
+
+  BleJsonWriter writer;
+  writer.beginObject();
+  writer.key(QLatin1String("events"));
+  writer.value(qint64(_trace.events()));
+  writer.endObject();
+  this->callback(scId, writer.text());
+}
+
+/**
+ * @brief BleCentral::startReplay
+ *
+ * Function startReplay replaces the radio with a replayed trace: scans
+ * report the traced scan results, connections and GATT operations are
+ * answered as traced and traced notifications are delivered to the
+ * subscriptions. The success callback is called when the replay starts
+ * and when it finished or was stopped.
+ *
+ * @param scId
+ * @param ecId
+ * @param path trace file, relative to the application data directory
+ * @param options speed: pace of the replay, 1 by default, 0 for no delays,
+ *        synthetic: generated traffic replayed instead of the trace, see
+ *        BleReplay::generate
+ */
+void BleCentral::startReplay(int scId, int ecId
+                             , const QString& path
+                             , const QVariantMap& options) {
+  if (!_peripherals.isEmpty() || isScanning()) {
+    // TODO i8n
+    this->cb(ecId, "Disconnect and stop scanning before replaying");
+    return;
+  }
+
+  QScopedPointer<BleReplay> replay(new BleReplay(this));
+  QString error;
+  const bool loaded = options.contains("synthetic")
+    ? replay->generate(options.value("synthetic").toMap(), &error)
+    : replay->load(dataFilePath(path), &error);
+  if (!loaded) {
+    this->cb(ecId, error);
+    return;
+  }
+
+  if (_replay && _replay->isRunning()) {
+    _replay->stop();
+    this->cb(_replayCallbackId, "ReplayStopped");
+  }
+  _replay.reset(replay.take());
+  _replayCallbackId = scId;
+  _replayDevices.clear();
+
+  QObject::connect(_replay.data(),
+                   &BleReplay::deviceDiscovered,
+                   this,
+                   [this](const QBluetoothDeviceInfo& di) {
+                     _replayDevices.insert(di.address().toUInt64(), di);
+                     if (_replayScanning) {
+                       deviceDiscovered(_scanCallbackId, di);
+                     }
+                   });
+  QObject::connect(_replay.data(),
+                   &BleReplay::finished,
+                   this,
+                   [this]() {
+                     this->cb(_replayCallbackId, "ReplayComplete");
+                   });
+
+  this->callbackWithoutRemove(scId, "\"ReplayStarted\"");
+  _replay->start(options.value("speed", 1.0).toDouble());
+}
+
+/**
+ * @brief BleCentral::stopReplay
+ *
+ * Function stopReplay stops the replay and goes back to the radio. A
+ * simulated peripheral is disconnected and a replayed scan is stopped.
+ *
+ * @param scId
+ * @param ecId
+ */
+void BleCentral::stopReplay(int scId, int ecId) {
+  if (!_replay) {
+    // TODO i8n
+    this->cb(ecId, "No replay is running");
+    return;
+  }
+
+  Q_FOREACH(BlePeripheral *peripheral, _peripherals.peripherals()) {
+    if (peripheral->isSimulated()) {
+      // TODO i8n
+      takePeripheral(peripheral->handle(),
+                     "Peripheral disconnected")->deleteLater();
+    }
+  }
+  if (_replayScanning) {
+    _replayScanning = false;
+    _scanBatchTimer.stop();
+    _presence.clear();
+  }
+
+  if (_replay->isRunning()) {
+    _replay->stop();
+    this->cb(_replayCallbackId, "ReplayStopped");
+  }
+  _replay.reset();
+  _replayDevices.clear();
+
+  this->cb(scId, "");
+}
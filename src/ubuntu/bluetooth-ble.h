@@ -21,22 +21,47 @@
 #ifndef BLUETOOTH_BLE_H
 #define BLUETOOTH_BLE_H
 
+#include <functional>
+
 #include <QVariant>
 #include <QString>
 #include <QMetaObject>
+#include <QHash>
+#include <QSharedPointer>
+#include <QTimer>
 
 #include <QBluetoothDeviceDiscoveryAgent>
 #include <QBluetoothDeviceInfo>
+#include <QBluetoothLocalDevice>
 #include <QLowEnergyController>
 #include <QLowEnergyService>
 
 #include <cplugin.h>
 
+#include "ble-advertisement.h"
+#include "ble-connection-pool.h"
+#include "ble-journal.h"
+#include "ble-json-writer.h"
+#include "ble-link-pool.h"
+#include "ble-merged-stream.h"
+#include "ble-peripheral.h"
+#include "ble-peripheral-table.h"
+#include "ble-presence.h"
+#include "ble-recorder.h"
+#include "ble-replay.h"
+#include "ble-scheduler.h"
+#include "ble-scan-filter.h"
+#include "ble-startup-profile.h"
+#include "ble-subscription.h"
+#include "ble-timer-wheel.h"
+#include "ble-trace.h"
+
 class BleCentral: public CPlugin {
     Q_OBJECT
 
 public:
     explicit BleCentral(Cordova *cordova);
+    ~BleCentral();
 
     virtual const QString fullName() override {
         return BleCentral::fullID();
@@ -81,15 +106,80 @@ public slots:
                               , const QString& serviceUuid
                               , const QString& characteristicUuid
                               , const QString& binaryData);
+    void readWithOptions(int scId, int ecId
+                         , const QString& deviceId
+                         , const QString& serviceUuid
+                         , const QString& characteristicUuid
+                         , const QVariantMap& options);
+    void writeWithOptions(int scId, int ecId
+                          , const QString& deviceId
+                          , const QString& serviceUuid
+                          , const QString& characteristicUuid
+                          , const QString& binaryData
+                          , const QVariantMap& options);
+
+    void readDescriptor(int scId, int ecId
+                        , const QString& deviceId
+                        , const QString& serviceUuid
+                        , const QString& characteristicUuid
+                        , const QString& descriptorUuid);
+    void writeDescriptor(int scId, int ecId
+                         , const QString& deviceId
+                         , const QString& serviceUuid
+                         , const QString& characteristicUuid
+                         , const QString& descriptorUuid
+                         , const QString& binaryData);
+
+    void setTimeouts(int scId, int ecId
+                     , const QVariantMap& options);
+    void cancelOperations(int scId, int ecId
+                          , const QString& deviceId);
+    void setConnectionPool(int scId, int ecId
+                           , const QVariantMap& options);
+
+    void requestMtu(int scId, int ecId
+                    , const QString& deviceId
+                    , int mtu);
+    void requestConnectionPriority(int scId, int ecId
+                                   , const QString& deviceId
+                                   , const QString& priority);
+    void startLinkNotifications(int scId, int ecId
+                                , const QString& deviceId);
+    void stopLinkNotifications(int scId, int ecId
+                               , const QString& deviceId);
+
+    void readMany(int scId, int ecId
+                  , const QString& deviceId
+                  , const QVariantList& reads);
+    void writeMany(int scId, int ecId
+                   , const QString& deviceId
+                   , const QVariantList& writes);
+    void writeTransaction(int scId, int ecId
+                          , const QString& deviceId
+                          , const QVariantList& writes
+                          , const QVariantMap& options);
 
     void startNotification(int scId, int ecId
                            , const QString& deviceId
                            , const QString& serviceUuid
                            , const QString& characteristicUuid);
+    void startNotificationWithOptions(int scId, int ecId
+                                      , const QString& deviceId
+                                      , const QString& serviceUuid
+                                      , const QString& characteristicUuid
+                                      , const QVariantMap& options);
     void stopNotification(int scId, int ecId
                           , const QString& deviceId
                           , const QString& serviceUuid
                           , const QString& characteristicUuid);
+    void startNotificationGroup(int scId, int ecId
+                                , const QVariantList& deviceIds
+                                , const QString& serviceUuid
+                                , const QString& characteristicUuid
+                                , const QVariantMap& options);
+    void stopNotificationGroup(int scId, int ecId
+                               , const QString& serviceUuid
+                               , const QString& characteristicUuid);
 
     void isEnabled(int scId, int ecId);
     void isConnected(int scId, int ecId
@@ -101,21 +191,147 @@ public slots:
     void enable(int scId, int ecId);
     void readRSSI(int scId, int ecId, const QString& deviceId);
 
+    void getStatistics(int scId, int ecId);
+    void warmUp(int scId, int ecId);
+    void getResourceUsage(int scId, int ecId);
+    void dumpJournal(int scId, int ecId);
+
+    void startRecording(int scId, int ecId
+                        , const QString& path
+                        , const QVariantMap& options);
+    void stopRecording(int scId, int ecId);
+    void getRecordingStatus(int scId, int ecId);
+
+    void startTrace(int scId, int ecId, const QString& path);
+    void stopTrace(int scId, int ecId);
+    void startReplay(int scId, int ecId
+                     , const QString& path
+                     , const QVariantMap& options);
+    void stopReplay(int scId, int ecId);
+
 private slots:
 
     void deviceDiscovered(int cbId, const QBluetoothDeviceInfo&);
     void deviceScanError(int cbId, QBluetoothDeviceDiscoveryAgent::Error);
     void bleServiceError(QLowEnergyService::ServiceError error);
+    void flushScanResults();
 
 private:
 
-    void startScanInternal(int scId, int ecId);
-    QVariantMap getConnectedDeviceInfos();
+    struct ScanResult {
+        ScanResult() : pending(false) {}
+
+        BleAdvertisement advertisement;
+        bool pending;
+    };
+
+    QBluetoothDeviceDiscoveryAgent *discoveryAgent();
+    QBluetoothLocalDevice *localDevice();
+    bool isScanning() const;
+    void startScanInternal(int scId, int ecId, const QVariantMap& options);
+    void connectSimulated(int scId, int ecId, const QString& deviceId);
+    void configurePeripheral(BlePeripheral *peripheral);
+    void applyTimeouts(BlePeripheral *peripheral);
+    BlePeripheral *peripheralFor(int ecId, const QString& deviceId);
+    BlePeripheral *linkFor(int ecId, const QString& deviceId);
+    BlePeripheral *openPooled(const QString& deviceId);
+    int links() const;
+    bool isIdle(int handle) const;
+    void pumpLinks();
+    void openLink(BlePeripheral *peripheral);
+    BlePeripheral *takePeripheral(int handle, const QString& error);
+    void closeLink(int handle, const QString& error);
+    void evict(int handle);
+    void sendValue(int cbId, BlePeripheral *peripheral,
+                   const QByteArray& value);
+    void sendLink(int cbId, BlePeripheral *peripheral, bool keepCallback);
+    bool priorityFor(int ecId, const QVariantMap& options,
+                     BleScheduler::Priority *priority);
+    void readInternal(int scId, int ecId
+                      , const QString& deviceId
+                      , const QString& serviceUuid
+                      , const QString& characteristicUuid
+                      , BleScheduler::Priority priority);
+    void writeInternal(int scId, int ecId
+                       , const QString& deviceId
+                       , const QString& serviceUuid
+                       , const QString& characteristicUuid
+                       , const QString& binaryData
+                       , bool withoutResponse
+                       , bool split
+                       , BleScheduler::Priority priority);
+    void startNotificationInternal(int scId, int ecId
+                                   , const QString& deviceId
+                                   , const QString& serviceUuid
+                                   , const QString& characteristicUuid
+                                   , const QVariantMap& options);
+    void enqueueBatch(int scId,
+                      BlePeripheral *peripheral,
+                      QList<BlePeripheral::Operation> operations,
+                      const QVariantList& tuples);
+    void describePeripheral(BlePeripheral *peripheral,
+                            const std::function<void(const QVariantMap&)>& done);
+    QVariantMap getConnectedDeviceInfos(BlePeripheral *peripheral);
+    void writeRecordingStatus(BleJsonWriter& writer) const;
+
+    // first member, its clock starts with the plugin construction
+    BleStartupProfile _startup;
+
+    // signal connections of the pending operations, declared before the
+    // objects emitting the signals
+    BleConnectionPool _connections;
 
+    // built on first use, they talk to BlueZ over D-Bus
     QScopedPointer<QBluetoothDeviceDiscoveryAgent> _discoveryAgent;
+    QScopedPointer<QBluetoothLocalDevice> _localDevice;
+
+    // reused for every advertisement of a scan
+    BleAdvertisement _advertisement;
+    BleScanFilter _scanFilter;
+    // reused for every scan callback message
+    BleJsonWriter _scanWriter;
+
+    // batched scan results, keyed by device address
+    QHash<quint64, ScanResult> _scanResults;
+    QTimer _scanBatchTimer;
+    int _scanCallbackId;
+
+    // declared before the peripherals using them
+    BleTimerWheel _timers;
+    // enter, exit and zone events in place of scan results while enabled
+    BlePresence _presence;
+    BleJournal _journal;
+    BleRecorder _recorder;
+    BleTrace _trace;
+    // simulated backend, replaces the radio while set
+    QScopedPointer<BleReplay> _replay;
+    bool _replayScanning;
+    int _replayCallbackId;
+    // devices the replay reported so far, by address, reported again at
+    // the start of every replayed scan
+    QHash<quint64, QBluetoothDeviceInfo> _replayDevices;
+
+    // ms, 0 for none
+    int _connectTimeout;
+    int _readTimeout;
+    int _writeTimeout;
+    int _descriptorTimeout;
+
+    // links opened on demand, see setConnectionPool
+    BleLinkPool _linkPool;
+    // notifications of all subscriptions since the plugin started
+    BleSubscription::Counters _notificationCounters;
+    // notification groups, by characteristic
+    QHash<BlePeripheral::CharacteristicKey,
+          QSharedPointer<BleMergedStream> > _streams;
 
-    // more than one?
-    QScopedPointer<QLowEnergyController> _connectedDevice;
+    // declared before the peripherals completing its jobs, and after
+    // the state its callbacks reach
+    BleScheduler _scheduler;
+    // last transaction id handed to the operation queues
+    quint64 _transactions;
+    // connected and connecting peripherals
+    BlePeripheralTable _peripherals;
 };
 
 #endif // #ifdef BLUETOOTH_BLE_H
@@ -1,3 +1,33 @@
+// Ubuntu only: runs test against the generated traffic of options.synthetic
+// instead of the radio, see ble.startReplay. test gets a finish function to
+// call without arguments when it passed or with the reason it failed; the
+// replay is stopped and done is called either way.
+function withSyntheticReplay(options, test, done) {
+    var finished = false;
+
+    function finish(reason) {
+        if (finished) {
+            return;
+        }
+        finished = true;
+        expect(reason).toBeUndefined();
+        var stopped = function() {
+            done();
+        };
+        ble.stopReplay(stopped, stopped);
+    }
+
+    ble.startReplay(null, options, function(state) {
+        if (state === "ReplayStarted") {
+            test(finish);
+        }
+    }, finish);
+}
+
+// service and characteristic of the synthetic peripherals
+var SYNTHETIC_SERVICE = "ffe0";
+var SYNTHETIC_CHARACTERISTIC = "ffe1";
+
 exports.defineAutoTests = function () {
 
     describe('BLE object', function () {
@@ -11,6 +41,286 @@ exports.defineAutoTests = function () {
         });
     });
 
+    if (cordova.platformId !== 'ubuntu') {
+        return;
+    }
+
+    describe('Synthetic replay', function () {
+
+        // the synthetic peripherals are 02:00:00:00:00:01, 02:00:00:00:00:02, ...
+        function syntheticIds(count) {
+            var ids = [];
+            for (var i = 1; i <= count; i++) {
+                ids.push("02:00:00:00:00:" + ("0" + i.toString(16).toUpperCase()).slice(-2));
+            }
+            return ids;
+        }
+
+        function connectAll(ids, connected, finish) {
+            if (ids.length === 0) {
+                connected();
+                return;
+            }
+            ble.connect(ids[0], function() {
+                connectAll(ids.slice(1), connected, finish);
+            }, finish);
+        }
+
+        function read(id, priority, success, finish) {
+            ble.readWithOptions(id, SYNTHETIC_SERVICE, SYNTHETIC_CHARACTERISTIC,
+                { priority: priority }, success, finish);
+        }
+
+        // Notifies alternating IEEE-11073 SFLOAT payloads: 0xF7FF has a non
+        // zero exponent and is 204.7, only 0x07FF is NaN (null in JSON).
+        it("should decode SFLOAT special values by their exact codes", function (done) {
+
+            var id = syntheticIds(1)[0];
+            // little endian payloads of 0xF7FF and 0x07FF
+            var synthetic = {
+                devices: 1,
+                advertisingInterval: 500,
+                notifications: 100,
+                values: ["fff7", "ff07"]
+            };
+            var received = [];
+
+            withSyntheticReplay({ synthetic: synthetic }, function(finish) {
+                ble.connect(id, function() {
+                    ble.startNotificationWithOptions(id, SYNTHETIC_SERVICE, SYNTHETIC_CHARACTERISTIC,
+                        { decoder: "ieee11073SFloat" }, function(values) {
+                            received.push(values[0]);
+                            if (received.length < 10) {
+                                return;
+                            }
+                            var alternating = received.every(function(value, i) {
+                                return (value === 204.7 || value === null)
+                                    && (i === 0 || value !== received[i - 1]);
+                            });
+                            finish(alternating ? undefined : "decoded " + JSON.stringify(received));
+                        }, finish);
+                }, finish);
+            }, done);
+        }, 30000);
+
+        // Floods six synthetic peripherals with bulk reads and fails if more
+        // than the scheduler limit of 4 ran at once, or if the reads were not
+        // shared evenly between the peripherals.
+        it("should limit the operations in flight", function (done) {
+
+            var ids = syntheticIds(6);
+            var reads = 20;
+
+            withSyntheticReplay({ synthetic: { devices: ids.length, duration: 10 } }, function(finish) {
+                connectAll(ids, function() {
+                    var maxInFlight = 0;
+                    var polling = setInterval(function() {
+                        ble.getStatistics(function(statistics) {
+                            maxInFlight = Math.max(maxInFlight, statistics.scheduler.inFlight);
+                        }, finish);
+                    }, 5);
+
+                    var completed = ids.map(function() { return 0; });
+                    var remaining = ids.length * reads;
+                    var shares = null;
+
+                    ids.forEach(function(id, p) {
+                        for (var i = 0; i < reads; i++) {
+                            read(id, "bulk", function() {
+                                if (++completed[p] === reads && !shares) {
+                                    // shares of the other peripherals by now
+                                    shares = completed.slice();
+                                }
+                                if (--remaining > 0) {
+                                    return;
+                                }
+                                clearInterval(polling);
+                                if (maxInFlight > 4) {
+                                    finish(maxInFlight + " operations in flight");
+                                } else if (maxInFlight < 4) {
+                                    finish("at most " + maxInFlight + " operations in flight, the peripherals did not run concurrently");
+                                } else if (Math.min.apply(null, shares) < 0.5 * reads) {
+                                    finish("uneven shares " + shares.join(", "));
+                                } else {
+                                    finish();
+                                }
+                            }, finish);
+                        }
+                    });
+                }, finish);
+            }, done);
+        }, 30000);
+
+        // Queues as many control, interactive and bulk reads on one synthetic
+        // peripheral and fails if, while all three classes were waiting, they
+        // did not complete in about the 16:4:1 ratio of their weights.
+        it("should share a peripheral by class weight", function (done) {
+
+            var id = syntheticIds(1)[0];
+            var reads = 64;
+
+            withSyntheticReplay({ synthetic: { devices: 1, duration: 10 } }, function(finish) {
+                ble.connect(id, function() {
+                    var completed = { control: 0, interactive: 0, bulk: 0 };
+                    var backlogged = null;
+                    var remaining = 3 * reads;
+
+                    ["bulk", "interactive", "control"].forEach(function(priority) {
+                        for (var i = 0; i < reads; i++) {
+                            read(id, priority, function() {
+                                completed[priority]++;
+                                if (!backlogged && completed[priority] === reads) {
+                                    // one class drained, the others stop competing
+                                    backlogged = {
+                                        control: completed.control,
+                                        interactive: completed.interactive,
+                                        bulk: completed.bulk
+                                    };
+                                }
+                                if (--remaining > 0) {
+                                    return;
+                                }
+                                var controlShare = backlogged.control / backlogged.interactive;
+                                var interactiveShare = backlogged.interactive / backlogged.bulk;
+                                if (controlShare < 3 || controlShare > 5.5 || interactiveShare < 2) {
+                                    finish("completed " + JSON.stringify(backlogged) +
+                                           " while all classes were waiting, expected about 16:4:1");
+                                } else {
+                                    finish();
+                                }
+                            }, finish);
+                        }
+                    });
+                }, finish);
+            }, done);
+        }, 30000);
+
+        // Scans synthetic advertisements and fails if formatting them
+        // allocated once the scan buffer fit the largest result.
+        it("should format scan results without allocating", function (done) {
+
+            // results before the baseline, the buffer grows to fit them
+            var warmUp = 50;
+            var results = 0;
+            var baseline = null;
+
+            var synthetic = { devices: 20, advertisements: 20, advertisingInterval: 2 };
+            withSyntheticReplay({ synthetic: synthetic }, function(finish) {
+                ble.startScan([], function() {
+                    if (++results === warmUp) {
+                        ble.getStatistics(function(statistics) {
+                            baseline = statistics.buffers.scan;
+                        }, finish);
+                    }
+                }, finish);
+
+                // the synthetic advertisements are all out by then
+                setTimeout(function() {
+                    ble.stopScan(function() {
+                        ble.getStatistics(function(statistics) {
+                            var scan = statistics.buffers.scan;
+                            if (!baseline) {
+                                finish("fewer than " + warmUp + " scan results");
+                            } else if (scan.allocations !== baseline.allocations) {
+                                finish("allocations " + baseline.allocations + " -> " + scan.allocations);
+                            } else {
+                                finish();
+                            }
+                        }, finish);
+                    }, finish);
+                }, 2000);
+            }, done);
+        }, 30000);
+
+        // Cycles scan, connect, subscribe, write and disconnect against a
+        // synthetic peripheral and fails if the resources of the plugin grew.
+        it("should not leak over connection cycles", function (done) {
+
+            var iterations = 2000;
+            // cycles before the baseline, caches and buffers are filled
+            var warmUp = 50;
+            // resident memory the allocator may keep around, in bytes
+            var rssSlack = 4 * 1024 * 1024;
+
+            var deviceId = null;
+            var baseline = null;
+
+            withSyntheticReplay({ speed: 0, synthetic: { devices: 1 } }, function(finish) {
+
+                // deleteLater() runs once the event loop is back
+                function sample(next) {
+                    setTimeout(function() {
+                        ble.getResourceUsage(next, finish);
+                    }, 100);
+                }
+
+                function grown(usage) {
+                    var keys = ['objects', 'peripherals', 'subscriptions',
+                                'connections', 'connectionGroups', 'fds'];
+                    var problems = keys.filter(function(key) {
+                        return usage[key] !== null && usage[key] > baseline[key];
+                    }).map(function(key) {
+                        return key + " " + baseline[key] + " -> " + usage[key];
+                    });
+                    if (usage.rss !== null && usage.rss > baseline.rss + rssSlack) {
+                        problems.push("rss " + baseline.rss + " -> " + usage.rss);
+                    }
+                    return problems;
+                }
+
+                function cycle(i) {
+                    if (i === warmUp) {
+                        sample(function(usage) {
+                            baseline = usage;
+                            scan(i);
+                        });
+                        return;
+                    }
+                    if (i === iterations) {
+                        sample(function(usage) {
+                            var problems = grown(usage);
+                            finish(problems.length ? problems.join(", ") : undefined);
+                        });
+                        return;
+                    }
+                    scan(i);
+                }
+
+                // every replayed scan reports the devices replayed so far
+                function scan(i) {
+                    ble.startScan([], function(device) {
+                        deviceId = deviceId || device.id;
+                    }, finish);
+                    ble.stopScan(function() {
+                        if (!deviceId) {
+                            finish("no peripheral in the scan results");
+                            return;
+                        }
+                        ble.connect(deviceId, function() {
+                            exercise(i);
+                        }, finish);
+                    }, finish);
+                }
+
+                function exercise(i) {
+                    ble.startNotification(deviceId, SYNTHETIC_SERVICE, SYNTHETIC_CHARACTERISTIC,
+                        function() {}, finish);
+                    ble.write(deviceId, SYNTHETIC_SERVICE, SYNTHETIC_CHARACTERISTIC,
+                        new Uint8Array([i & 0xff]).buffer, function() {
+                            ble.stopNotification(deviceId, SYNTHETIC_SERVICE, SYNTHETIC_CHARACTERISTIC,
+                                function() {
+                                    ble.disconnect(deviceId, function() {
+                                        cycle(i + 1);
+                                    }, finish);
+                                }, finish);
+                        }, finish);
+                }
+
+                cycle(0);
+            }, done);
+        }, 600000);
+    });
+
 };
 
 exports.defineManualTests = function (contentEl, createActionButton) {
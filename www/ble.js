@@ -28,6 +28,15 @@ var base64ToArrayBuffer = function(b64) {
     return stringToArrayBuffer(atob(b64));
 };
 
+var arrayBufferToBase64 = function(buffer) {
+    var bytes = new Uint8Array(buffer);
+    var binary = '';
+    for (var i = 0; i < bytes.length; i++) {
+        binary += String.fromCharCode(bytes[i]);
+    }
+    return btoa(binary);
+};
+
 function massageMessageNativeToJs(message) {
     if (message.CDVType == 'ArrayBuffer') {
         message = base64ToArrayBuffer(message.data);
@@ -102,11 +111,149 @@ module.exports = {
         cordova.exec(success, failure, 'BLE', 'read', [device_id, service_uuid, characteristic_uuid]);
     },
 
+    // Ubuntu only, options.priority is "control", "interactive" or "bulk"
+    readWithOptions: function (device_id, service_uuid, characteristic_uuid, options, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'readWithOptions', [device_id, service_uuid, characteristic_uuid, options || {}]);
+    },
+
+    // Ubuntu only, descriptor value comes back as ArrayBuffer in the success callback
+    readDescriptor: function (device_id, service_uuid, characteristic_uuid, descriptor_uuid, success, failure) {
+        var successWrapper = function(value) {
+            success(massageMessageNativeToJs(value));
+        };
+        cordova.exec(successWrapper, failure, 'BLE', 'readDescriptor', [device_id, service_uuid, characteristic_uuid, descriptor_uuid]);
+    },
+
+    // Ubuntu only, value must be an ArrayBuffer
+    writeDescriptor: function (device_id, service_uuid, characteristic_uuid, descriptor_uuid, value, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'writeDescriptor', [device_id, service_uuid, characteristic_uuid, descriptor_uuid, value]);
+    },
+
+    // Ubuntu only, reads is a list of [service_uuid, characteristic_uuid]
+    // results come back as a list of {service, characteristic, status, value|error}
+    readMany: function (device_id, reads, success, failure) {
+        var successWrapper = function(results) {
+            convertToNativeJS(results);
+            success(results);
+        };
+        cordova.exec(successWrapper, failure, 'BLE', 'readMany', [device_id, reads]);
+    },
+
+    // Ubuntu only, writes is a list of [service_uuid, characteristic_uuid, ArrayBuffer]
+    // results come back as a list of {service, characteristic, status, error}
+    writeMany: function (device_id, writes, success, failure) {
+        var encoded = writes.map(function(write) {
+            return [write[0], write[1], arrayBufferToBase64(write[2])];
+        });
+        cordova.exec(success, failure, 'BLE', 'writeMany', [device_id, encoded]);
+    },
+
+    // Ubuntu only, writes is a list of [service_uuid, characteristic_uuid, ArrayBuffer]
+    // written as a unit, options: rollback (false by default), priority
+    // results come back as {status, error, writes: [{service, characteristic, status}]}
+    writeTransaction: function (device_id, writes, options, success, failure) {
+        var encoded = writes.map(function(write) {
+            return [write[0], write[1], arrayBufferToBase64(write[2])];
+        });
+        cordova.exec(success, failure, 'BLE', 'writeTransaction', [device_id, encoded, options || {}]);
+    },
+
     // RSSI value comes back as an integer
     readRSSI: function(device_id, success, failure) {
         cordova.exec(success, failure, 'BLE', 'readRSSI', [device_id]);
     },
 
+    // Ubuntu only, success callback is called with an object of counters
+    getStatistics: function(success, failure) {
+        cordova.exec(success, failure, 'BLE', 'getStatistics', []);
+    },
+
+    // Ubuntu only, builds the Bluetooth objects left out of plugin loading,
+    // success callback is called with the startup profile
+    warmUp: function(success, failure) {
+        cordova.exec(success, failure, 'BLE', 'warmUp', []);
+    },
+
+    // Ubuntu only, success callback is called with the Qt objects, signal
+    // connections, memory and file descriptors in use
+    getResourceUsage: function(success, failure) {
+        cordova.exec(success, failure, 'BLE', 'getResourceUsage', []);
+    },
+
+    // Ubuntu only, timeouts in ms: connect, read, write, descriptor
+    setTimeouts: function(options, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'setTimeouts', [options || {}]);
+    },
+
+    // Ubuntu only, fails the pending operations of the peripheral
+    cancelOperations: function(device_id, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'cancelOperations', [device_id]);
+    },
+
+    // Ubuntu only, GATT calls open links to peripherals not connected,
+    // keeping at most maxConnections, 0 to disable
+    setConnectionPool: function(options, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'setConnectionPool', [options || {}]);
+    },
+
+    // Ubuntu only, success callback is called with the MTU of the link
+    requestMtu: function(device_id, mtu, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'requestMtu', [device_id, mtu]);
+    },
+
+    // Ubuntu only, priority is "high", "balanced" or "low"
+    requestConnectionPriority: function(device_id, priority, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'requestConnectionPriority', [device_id, priority]);
+    },
+
+    // Ubuntu only, success callback is called with the link state on every change
+    startLinkNotifications: function(device_id, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'startLinkNotifications', [device_id]);
+    },
+
+    // Ubuntu only
+    stopLinkNotifications: function(device_id, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'stopLinkNotifications', [device_id]);
+    },
+
+    // Ubuntu only, success callback is called with the recent plugin events
+    dumpJournal: function(success, failure) {
+        cordova.exec(success, failure, 'BLE', 'dumpJournal', []);
+    },
+
+    // Ubuntu only, success callbacks are called with the recording status
+    startRecording: function(path, options, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'startRecording', [path, options || {}]);
+    },
+
+    stopRecording: function(success, failure) {
+        cordova.exec(success, failure, 'BLE', 'stopRecording', []);
+    },
+
+    getRecordingStatus: function(success, failure) {
+        cordova.exec(success, failure, 'BLE', 'getRecordingStatus', []);
+    },
+
+    // Ubuntu only, traces scan results, connections and GATT traffic
+    startTrace: function(path, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'startTrace', [path]);
+    },
+
+    stopTrace: function(success, failure) {
+        cordova.exec(success, failure, 'BLE', 'stopTrace', []);
+    },
+
+    // Ubuntu only, success callback is called with "ReplayStarted",
+    // then "ReplayComplete" or "ReplayStopped"
+    // options: speed, synthetic (generated traffic instead of the trace at path)
+    startReplay: function(path, options, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'startReplay', [path, options || {}]);
+    },
+
+    stopReplay: function(success, failure) {
+        cordova.exec(success, failure, 'BLE', 'stopReplay', []);
+    },
+
     // value must be an ArrayBuffer
     write: function (device_id, service_uuid, characteristic_uuid, value, success, failure) {
         cordova.exec(success, failure, 'BLE', 'write', [device_id, service_uuid, characteristic_uuid, value]);
@@ -117,6 +264,14 @@ module.exports = {
         cordova.exec(success, failure, 'BLE', 'writeWithoutResponse', [device_id, service_uuid, characteristic_uuid, value]);
     },
 
+    // Ubuntu only, value must be an ArrayBuffer
+    // options.priority is "control", "interactive" or "bulk",
+    // options.withoutResponse selects writeWithoutResponse,
+    // options.split sends values longer than the MTU allows in pieces
+    writeWithOptions: function (device_id, service_uuid, characteristic_uuid, value, options, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'writeWithOptions', [device_id, service_uuid, characteristic_uuid, value, options || {}]);
+    },
+
     // value must be an ArrayBuffer
     writeCommand: function (device_id, service_uuid, characteristic_uuid, value, success, failure) {
         console.log("WARNING: writeCommand is deprecated, use writeWithoutResponse");
@@ -134,11 +289,32 @@ module.exports = {
         cordova.exec(success, failure, 'BLE', 'startNotification', [device_id, service_uuid, characteristic_uuid]);
     },
 
+    // Ubuntu only, options.decoder selects a native value decoder
+    // success callback is called on notification with an array of numbers
+    startNotificationWithOptions: function (device_id, service_uuid, characteristic_uuid, options, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'startNotificationWithOptions', [device_id, service_uuid, characteristic_uuid, options || {}]);
+    },
+
     // success callback is called when the descriptor 0x2902 is written
     stopNotification: function (device_id, service_uuid, characteristic_uuid, success, failure) {
         cordova.exec(success, failure, 'BLE', 'stopNotification', [device_id, service_uuid, characteristic_uuid]);
     },
 
+    // Ubuntu only, success callback is called with batches of
+    // {device, t, value: ArrayBuffer} merged across the peripherals
+    startNotificationGroup: function (device_ids, service_uuid, characteristic_uuid, options, success, failure) {
+        var successWrapper = function(samples) {
+            convertToNativeJS(samples);
+            success(samples);
+        };
+        cordova.exec(successWrapper, failure, 'BLE', 'startNotificationGroup', [device_ids, service_uuid, characteristic_uuid, options || {}]);
+    },
+
+    // Ubuntu only
+    stopNotificationGroup: function (service_uuid, characteristic_uuid, success, failure) {
+        cordova.exec(success, failure, 'BLE', 'stopNotificationGroup', [service_uuid, characteristic_uuid]);
+    },
+
     isConnected: function (device_id, success, failure) {
         cordova.exec(success, failure, 'BLE', 'isConnected', [device_id]);
     },